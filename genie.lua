@@ -73,6 +73,13 @@ project "LD37"
 	}
 	linkoptions { "/subsystem:windows" }
 	
+	-- fold expressions (Ordinator)
+	configuration {"vs*"}
+		buildoptions_cpp { "/std:c++17" }
+	configuration {"not vs*"}
+		buildoptions_cpp { "-std=c++17" }
+	configuration {}
+	
 	flags {
 		"NoExceptions",
 		"NoRTTI",
@@ -27,7 +27,7 @@ lsk_Block lsk_Mallocator::_alloc(const char* filename, i32 line, u64 size, u8 al
 	assert(ptr);
 	memset(ptr, 0, size);
 
-	++_allocCount;
+	_allocCount.fetch_add(1, std::memory_order_relaxed);
 
 	i32 adjust = alignAdjust((intptr_t)ptr, alignment);
 	return lsk_Block{(void*)((intptr_t)ptr + adjust), ptr, size - adjust};
@@ -54,7 +54,7 @@ void lsk_Mallocator::_dealloc(const char* filename, i32 line, lsk_Block block)
 	if(!block.ptr || !block._notaligned) return;
 	//lsk_printf("%s:%d deallocate(%#x, %d)", filename, line, block.ptr, block.size);
 	free(block._notaligned);
-	--_allocCount;
+	_allocCount.fetch_sub(1, std::memory_order_relaxed);
 }
 
 void lsk_AllocatorStack::init(lsk_Block block)
@@ -18,6 +18,7 @@
 */
 
 #include <stdlib.h>
+#include <atomic>
 #include "lsk_types.h"
 #include "lsk_console.h"
 #include "lsk_utils.h"
@@ -72,10 +73,11 @@ struct lsk_Mallocator: public lsk_IAllocator
 {
 	SINGLETON_IMP(lsk_Mallocator)
 
-	i32 _allocCount = 0;
+	std::atomic<i32> _allocCount{0}; // JobPool workers allocate too
 	~lsk_Mallocator() {
-		if(_allocCount != 0) {
-			lsk_errf("%d leaks", _allocCount);
+		const i32 allocCount = _allocCount.load();
+		if(allocCount != 0) {
+			lsk_errf("%d leaks", allocCount);
 		}
 	}
 
@@ -954,6 +954,18 @@ struct lsk_DSparseArray
 		return _data[_refId[refIndex]];
 	}
 
+	// data index of a ref slot (changes on remove)
+	inline u32 dataId(u32 refIndex) const {
+		assert(refIndex < _capacity && _refId[refIndex] >= 0 && _refId[refIndex] < _count);
+		return (u32)_refId[refIndex];
+	}
+
+	// ref slot of a data index (stable)
+	inline u32 refId(u32 did) const {
+		assert(did < _count);
+		return (u32)(_refIdPtr[did] - _refId);
+	}
+
 	inline Ref<T> getRef(const T& elt) {
 		const T* eltPtr = &elt;
 		assert_msg((char*)eltPtr >= (char*)_data && (char*)eltPtr < ((char*)_data + _count * sizeof(T)),
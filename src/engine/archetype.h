@@ -0,0 +1,186 @@
+#pragma once
+#include <new>
+#include <utility>
+#include <lsk/lsk_array.h>
+#include "meta.h"
+
+#define ARCHETYPE_CHUNK_SIZE (16 * 1024) // bytes
+#define ARCHETYPE_CHUNK_ALIGN 64
+
+// stale once the row was removed, the generation no longer matches
+struct ArchetypeHandle
+{
+	u32 _id = 0xffffffff;
+	u32 _generation = 0;
+};
+
+/**
+ * Archetype storage: rows sharing the same component set, in fixed size chunks
+ * - a chunk holds one column per component (plus the row ids), side by side
+ * - rows are packed: every chunk is full except the last, remove() moves the last row in the hole
+ * - forEach() walks the columns linearly, no Ref indirection per component
+ * - handles go through a slot table, row moves don't invalidate them
+ */
+template<typename... Components>
+struct ArchetypeStorage
+{
+	static constexpr u32 _sizes[] = {sizeof(u32), sizeof(Components)...};
+	static constexpr u32 _aligns[] = {alignof(u32), alignof(Components)...};
+	static constexpr u32 ROW_SIZE = (sizeof(u32) + ... + sizeof(Components));
+	// worst case padding between columns is taken off the chunk
+	static constexpr u32 CHUNK_CAPACITY = (ARCHETYPE_CHUNK_SIZE - (alignof(u32) + ... + alignof(Components))) / ROW_SIZE;
+	static_assert(CHUNK_CAPACITY > 0, "Components don't fit in a chunk");
+
+	struct Slot {
+		u32 row; // next free slot when free
+		u32 generation;
+	};
+
+	lsk_DArray<lsk_Block> _chunks;
+	lsk_DArray<Slot> _slots;
+	i32 _freeSlot = -1;
+	u32 _count = 0;
+
+	static constexpr u32 _columnOffset(i32 column) {
+		u32 offset = 0;
+		for(i32 c = 0; c <= column; ++c) {
+			offset = (offset + _aligns[c] - 1) & ~(_aligns[c] - 1);
+			if(c < column) {
+				offset += _sizes[c] * CHUNK_CAPACITY;
+			}
+		}
+		return offset;
+	}
+
+	template<typename T>
+	static constexpr i32 columnId() {
+		return 1 + TypeIndex<T, Components...>::value;
+	}
+
+	void init(u32 chunkCapacity = 8) {
+		_chunks.init(chunkCapacity);
+		_slots.init(CHUNK_CAPACITY);
+		_freeSlot = -1;
+		_count = 0;
+	}
+
+	void destroy() {
+		for(u32 row = 0; row < _count; ++row) {
+			(_column<Components>(row / CHUNK_CAPACITY)[row % CHUNK_CAPACITY].~Components(), ...);
+		}
+		_count = 0;
+		for(auto& block: _chunks) {
+			AllocDefault.deallocate(block);
+		}
+		_chunks.destroy();
+		_slots.destroy();
+	}
+
+	ArchetypeHandle add(const Components&... comps) {
+		if(_count == _chunks.count() * CHUNK_CAPACITY) {
+			lsk_Block block = AllocDefault.allocate(ARCHETYPE_CHUNK_SIZE, ARCHETYPE_CHUNK_ALIGN);
+			assert_msg(block.ptr, "Out of memory");
+			_chunks.push(block);
+		}
+
+		u32 id;
+		if(_freeSlot != -1) {
+			id = (u32)_freeSlot;
+			_freeSlot = (i32)_slots[id].row;
+		}
+		else {
+			id = _slots.count();
+			_slots.push({0, 0});
+		}
+
+		const u32 row = _count++;
+		const u32 chunk = row / CHUNK_CAPACITY;
+		const u32 r = row % CHUNK_CAPACITY;
+		_ids(chunk)[r] = id;
+		(new(_column<Components>(chunk) + r) Components(comps), ...);
+		_slots[id].row = row;
+
+		ArchetypeHandle handle;
+		handle._id = id;
+		handle._generation = _slots[id].generation;
+		return handle;
+	}
+
+	void remove(ArchetypeHandle handle) {
+		assert_msg(valid(handle), "Stale archetype handle");
+		const u32 row = _slots[handle._id].row;
+		const u32 last = --_count;
+		(_moveRow<Components>(last, row), ...);
+
+		if(row != last) {
+			const u32 movedId = _ids(last / CHUNK_CAPACITY)[last % CHUNK_CAPACITY];
+			_ids(row / CHUNK_CAPACITY)[row % CHUNK_CAPACITY] = movedId;
+			_slots[movedId].row = row;
+		}
+
+		Slot& slot = _slots[handle._id];
+		++slot.generation;
+		slot.row = (u32)_freeSlot;
+		_freeSlot = (i32)handle._id;
+	}
+
+	inline bool valid(ArchetypeHandle handle) const {
+		return handle._id < _slots.count() && _slots[handle._id].generation == handle._generation;
+	}
+
+	template<typename T>
+	inline T& get(ArchetypeHandle handle) {
+		assert_msg(valid(handle), "Stale archetype handle");
+		const u32 row = _slots[handle._id].row;
+		return _column<T>(row / CHUNK_CAPACITY)[row % CHUNK_CAPACITY];
+	}
+
+	inline u32 count() const {
+		return _count;
+	}
+
+	inline u32 chunkCount() const {
+		return (_count + CHUNK_CAPACITY - 1) / CHUNK_CAPACITY;
+	}
+
+	inline u32 chunkRowCount(u32 chunk) const {
+		return lsk_min(_count - chunk * CHUNK_CAPACITY, CHUNK_CAPACITY);
+	}
+
+	// f(T&...) on every row, chunk by chunk
+	template<typename... T, typename F>
+	void forEach(F&& f) {
+		const u32 chunkCount_ = chunkCount();
+		for(u32 c = 0; c < chunkCount_; ++c) {
+			_forEachRow(f, chunkRowCount(c), _column<T>(c)...);
+		}
+	}
+
+	template<typename T>
+	inline T* _column(u32 chunk) {
+		return (T*)((u8*)_chunks[chunk].ptr + _columnOffset(columnId<T>()));
+	}
+
+	inline u32* _ids(u32 chunk) {
+		return (u32*)((u8*)_chunks[chunk].ptr + _columnOffset(0));
+	}
+
+	// destroys dst, moves src into it
+	template<typename T>
+	inline void _moveRow(u32 src, u32 dst) {
+		T* pDst = _column<T>(dst / CHUNK_CAPACITY) + dst % CHUNK_CAPACITY;
+		pDst->~T();
+		if(src != dst) {
+			T* pSrc = _column<T>(src / CHUNK_CAPACITY) + src % CHUNK_CAPACITY;
+			new(pDst) T(std::move(*pSrc));
+			pSrc->~T();
+		}
+	}
+
+	template<typename F, typename... T>
+	static inline void _forEachRow(F& f, u32 rowCount, T*... columns) {
+		for(u32 r = 0; r < rowCount; ++r) {
+			f(columns[r]...);
+		}
+	}
+};
@@ -13,22 +13,21 @@ Actor::Actor()
 void Sprite::update(f64 delta)
 {
 	assert(transform.valid());
-	assert(materialName > 0);
+	queue(transform.get(), transform._id + 1);
+}
 
-	lsk_Mat4 modelMatrix = lsk_Mat4Translate(lsk_Vec3{transform->position.x, transform->position.y, 0}
-											 + lsk_Vec3{localPos, 0});
-	if(!lsk_QuatIsNull(transform->rotation)) {
-		modelMatrix = modelMatrix * lsk_QuatMatrix(transform->rotation);
-	}
-	if(origin.x != 0 || origin.y != 0) {
-		modelMatrix = modelMatrix * lsk_Mat4Translate(lsk_Vec3{-origin, 0});
-	}
-	modelMatrix = modelMatrix * lsk_Mat4Scale(transform->scale * lsk_Vec3{size, 1});
+void Sprite::queue(const Transform& transform, u32 interpId) const
+{
+	assert(materialName > 0);
 
 	DrawCommand cmd;
 	cmd.vao = Renderer._quadVao;
-	cmd.modelMatrix = modelMatrix;
-	cmd.z = transform->position.z;
+	cmd.setTransform(lsk_Vec2{transform.position.x, transform.position.y} + localPos,
+					 lsk_Vec2{transform.scale.x * size.x, transform.scale.y * size.y},
+					 quatAngle2D(transform.rotation), origin);
+	cmd.z = transform.position.z;
+	cmd.interpId = interpId;
+	cmd.interpPos = {transform.position.x, transform.position.y};
 	cmd.setMaterial(materialName);
 	Renderer.queue(cmd);
 }
@@ -3,18 +3,32 @@
 #include <lsk/lsk_math.h>
 #include <lsk/lsk_array.h>
 
+/**
+ * Entity base, no virtual functions
+ * - the Ordinator keeps each entity type in its own array and calls its functions directly
+ * - types hide beginPlay/update/endPlay instead of overriding them, entity types are final
+ * - forEachComponent() calls f on each owned component Ref, they're destroyed with the entity
+ */
 struct IEntityBase
 {
-	u32 _entityId = 0;
+	u32 _entityId = 0; // Ref id, set by Ordinator::spawn()
 	bool _markedAsDestroy = false;
+	lsk_DArray<u32>* _pDestroyQueue = nullptr; // pending destroys of this entity type
 
+	// destroyed at the start of the next Ordinator::update()
 	inline void destroy() {
+		if(_markedAsDestroy) return;
 		_markedAsDestroy = true;
+		assert_msg(_pDestroyQueue, "Entity was not spawned by the Ordinator");
+		_pDestroyQueue->push(_entityId);
 	}
 
-	virtual void beginPlay() {}
-	virtual void update(f64 delta) {}
-	virtual void endPlay() {}
+	void beginPlay() {}
+	void update(f64 delta) {}
+	void endPlay() {}
+
+	template<typename F>
+	void forEachComponent(F&& f) {}
 
 protected:
 	IEntityBase() {}
@@ -42,4 +56,6 @@ struct COMPONENT Sprite
 	void beginPlay() {}
 	void update(f64 delta);
 	void endPlay() {}
+	// update() without the Ref, interpId: see DrawCommand
+	void queue(const Transform& transform, u32 interpId) const;
 };
@@ -0,0 +1,93 @@
+#include "coroutine.h"
+
+CoroutineHandle CoroutineScheduler::start(CoroutineFunc func, void* pUserData)
+{
+	i32 id = 0;
+	while(id < COROUTINE_MAX && _coroutines[id]._active) {
+		++id;
+	}
+	assert_msg(id < COROUTINE_MAX, "Too many coroutines, increase COROUTINE_MAX");
+
+	Coroutine& co = _coroutines[id];
+	co.func = func;
+	co.pUserData = pUserData;
+	co._resumePoint = 0;
+	co._active = true;
+	co._stopped = false;
+	co._timer = TimerHandle();
+
+	CoroutineHandle handle;
+	handle._id = (u32)id;
+	handle._generation = co._generation;
+
+	_resume(id, co._generation);
+	return handle;
+}
+
+bool CoroutineScheduler::stop(CoroutineHandle handle)
+{
+	if(handle._id >= COROUTINE_MAX) {
+		return false;
+	}
+
+	Coroutine& co = _coroutines[handle._id];
+	if(!co._active || co._stopped || co._generation != handle._generation) {
+		return false;
+	}
+
+	// a coroutine stopping itself is freed once its function returns
+	if((i32)handle._id == _current) {
+		co._stopped = true;
+		return true;
+	}
+
+	_free(handle._id);
+	return true;
+}
+
+void CoroutineScheduler::stopAll()
+{
+	for(i32 id = 0; id < COROUTINE_MAX; ++id) {
+		Coroutine& co = _coroutines[id];
+		if(co._active) {
+			stop({(u32)id, co._generation});
+		}
+	}
+}
+
+void CoroutineScheduler::_wait(Coroutine& co, f64 seconds)
+{
+	const u32 id = (u32)(&co - _coroutines);
+	const u32 generation = co._generation;
+	co._timer = Timers.add(seconds, [id, generation] {
+		Coroutines._resume(id, generation);
+	});
+}
+
+void CoroutineScheduler::_resume(i32 id, u32 generation)
+{
+	Coroutine& co = _coroutines[id];
+	if(!co._active || co._generation != generation) {
+		return;
+	}
+
+	// start() can be called from a coroutine, resumes nest
+	const i32 prevCurrent = _current;
+	_current = id;
+	co.func(co, co.pUserData);
+	_current = prevCurrent;
+
+	if(co._resumePoint == -1 || co._stopped) {
+		_free(id);
+	}
+}
+
+void CoroutineScheduler::_free(i32 id)
+{
+	Coroutine& co = _coroutines[id];
+	Timers.cancel(co._timer);
+	co._timer = TimerHandle();
+	co._active = false;
+	co._stopped = false;
+	++co._generation;
+}
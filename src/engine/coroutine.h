@@ -0,0 +1,71 @@
+#pragma once
+#include <lsk/lsk_array.h>
+#include "timer.h"
+
+#define COROUTINE_MAX 32
+
+struct Coroutine;
+typedef void (*CoroutineFunc)(Coroutine& co, void* pUserData);
+
+// stale once the coroutine ended or was stopped
+struct CoroutineHandle
+{
+	u32 _id = 0xffffffff;
+	u32 _generation = 0;
+};
+
+/**
+ * Stackless coroutine
+ * - the function is called again from the top on resume, CO_BEGIN jumps back to the last wait
+ * - locals don't survive a wait, keep that state in pUserData
+ * - waits are timers, a waiting coroutine costs nothing until the timer wheel resumes it
+ */
+struct Coroutine
+{
+	CoroutineFunc func = nullptr;
+	void* pUserData = nullptr;
+	i32 _resumePoint = 0; // -1 when ended
+	u32 _generation = 0;
+	u8 _active = false;
+	u8 _stopped = false; // stopped while running, freed when it returns
+	TimerHandle _timer;
+};
+
+// resume points are __COUNTER__ values (__LINE__ is not a constant with MSVC /ZI)
+#define CO_BEGIN(co) switch((co)._resumePoint) { case 0:
+
+#define CO_WAIT(co, seconds) do {\
+		(co)._resumePoint = __COUNTER__ + 1;\
+		Coroutines._wait(co, seconds);\
+		return;\
+		case __COUNTER__:;\
+	} while(0)
+
+// resumes on the next timer tick
+#define CO_YIELD(co) CO_WAIT(co, 0.0)
+
+#define CO_END(co) } (co)._resumePoint = -1;
+
+/**
+ * Fixed pool of coroutines, driven by the timer wheel (TimerManager::update() from IGameWindow::update())
+ * - start() runs the coroutine until its first wait
+ * - no allocation: coroutines live in a fixed array, waits use pooled timers with inline callbacks
+ */
+struct CoroutineScheduler
+{
+	SINGLETON_IMP(CoroutineScheduler)
+
+	Coroutine _coroutines[COROUTINE_MAX];
+	i32 _current = -1; // coroutine being resumed
+
+	CoroutineHandle start(CoroutineFunc func, void* pUserData);
+	// returns false when the coroutine already ended or was stopped
+	bool stop(CoroutineHandle handle);
+	void stopAll();
+
+	void _wait(Coroutine& co, f64 seconds);
+	void _resume(i32 id, u32 generation);
+	void _free(i32 id);
+};
+
+#define Coroutines CoroutineScheduler::get()
@@ -0,0 +1,119 @@
+#include "jobs.h"
+
+thread_local u32 JobPool::_threadId = 0;
+
+void JobPool::init(i32 workerCount)
+{
+	if(workerCount < 0) {
+		workerCount = (i32)std::thread::hardware_concurrency() - 1;
+	}
+	if(workerCount < 0) {
+		workerCount = 0;
+	}
+	if(workerCount > JOBS_MAX_THREADS - 1) {
+		workerCount = JOBS_MAX_THREADS - 1;
+	}
+
+	_quit = false;
+	_generation = 0;
+	_pending = 0;
+	_workerCount = workerCount;
+	for(u32 i = 0; i < _workerCount; ++i) {
+		_workers[i] = std::thread(&JobPool::_workerLoop, this, i + 1);
+	}
+}
+
+void JobPool::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+		++_generation;
+	}
+	_wakeCond.notify_all();
+
+	for(u32 i = 0; i < _workerCount; ++i) {
+		_workers[i].join();
+	}
+	_workerCount = 0;
+}
+
+void JobPool::parallelFor(u32 count, u32 minPerThread, JobRangeFunc func, void* pUserData)
+{
+	if(count == 0) {
+		return;
+	}
+
+	u32 chunkCount = threadCount();
+	if(minPerThread > 0 && count / minPerThread < chunkCount) {
+		chunkCount = count / minPerThread;
+	}
+
+	// inline on the calling thread, with its own id: chunk 0 may be running elsewhere
+	if(chunkCount <= 1) {
+		func(pUserData, 0, count, threadId());
+		return;
+	}
+
+	// nested: the workers are taken
+	if(_busy.exchange(true)) {
+		_nestedCount.fetch_add(1, std::memory_order_relaxed);
+		func(pUserData, 0, count, threadId());
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_func = func;
+		_pUserData = pUserData;
+		_count = count;
+		_chunkCount = chunkCount;
+		_pending = chunkCount - 1;
+		++_generation;
+	}
+	_wakeCond.notify_all();
+
+	_runChunk(0);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_doneCond.wait(lock, [this]{ return _pending == 0; });
+	_busy = false;
+}
+
+void JobPool::_runChunk(u32 chunk)
+{
+	const u32 begin = (u32)(((u64)_count * chunk) / _chunkCount);
+	const u32 end = (u32)(((u64)_count * (chunk + 1)) / _chunkCount);
+	_func(_pUserData, begin, end, chunk);
+}
+
+void JobPool::_workerLoop(u32 threadId)
+{
+	_threadId = threadId;
+	u32 generation = 0;
+	while(true) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wakeCond.wait(lock, [&]{ return _generation != generation; });
+			generation = _generation;
+			if(_quit) {
+				return;
+			}
+			// not needed for this job
+			if(threadId >= _chunkCount) {
+				continue;
+			}
+		}
+
+		_runChunk(threadId);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			last = --_pending == 0;
+		}
+		if(last) {
+			_doneCond.notify_one();
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <lsk/lsk_types.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define JOBS_MAX_THREADS 16
+
+// [begin, end) range of items, threadId is in [0, threadCount)
+typedef void (*JobRangeFunc)(void* pUserData, u32 begin, u32 end, u32 threadId);
+
+/**
+ * Fixed pool of worker threads
+ * - parallelFor() splits a range into contiguous chunks, one per thread, in thread order
+ * - the calling thread runs chunk 0 and blocks until every chunk is done
+ * - per-thread outputs merged in thread order are in the same order as a serial loop
+ * - parallelFor() called from a running job runs the whole range on the calling thread,
+ *   threadId is the calling thread's
+ */
+struct JobPool
+{
+	SINGLETON_IMP(JobPool)
+
+	std::thread _workers[JOBS_MAX_THREADS];
+	u32 _workerCount = 0;
+
+	std::mutex _mutex;
+	std::condition_variable _wakeCond;
+	std::condition_variable _doneCond;
+	u32 _generation = 0;
+	u32 _pending = 0;
+	bool _quit = false;
+	std::atomic<bool> _busy{false}; // a parallelFor() is running
+	std::atomic<u32> _nestedCount{0}; // parallelFor() calls run inline because the pool was busy
+
+	static thread_local u32 _threadId; // worker index + 1, 0 on any other thread
+
+	JobRangeFunc _func = nullptr;
+	void* _pUserData = nullptr;
+	u32 _count = 0;
+	u32 _chunkCount = 0;
+
+	// workerCount = -1: one worker per hardware thread minus the calling thread
+	void init(i32 workerCount = -1);
+	void destroy();
+
+	inline u32 threadCount() const {
+		return _workerCount + 1;
+	}
+
+	// stable per thread, in [0, JOBS_MAX_THREADS)
+	static inline u32 threadId() {
+		return _threadId;
+	}
+
+	// items are only split when each thread gets at least minPerThread of them
+	void parallelFor(u32 count, u32 minPerThread, JobRangeFunc func, void* pUserData);
+
+	void _runChunk(u32 chunk);
+	void _workerLoop(u32 threadId);
+};
+
+#define Jobs JobPool::get()
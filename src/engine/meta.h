@@ -1,4 +1,28 @@
 #pragma once
+#include <lsk/lsk_types.h>
 
+// tags only, types are registered in the Ordinator type lists
 #define ENTITY
 #define COMPONENT
+
+template<typename... Types>
+struct TypeList {};
+
+// constexpr index of T in Types
+template<typename T, typename... Types>
+struct TypeIndex
+{
+	static_assert(sizeof(T) == 0, "Type is not in the list");
+};
+
+template<typename T, typename... Rest>
+struct TypeIndex<T, T, Rest...>
+{
+	static constexpr i32 value = 0;
+};
+
+template<typename T, typename First, typename... Rest>
+struct TypeIndex<T, First, Rest...>
+{
+	static constexpr i32 value = 1 + TypeIndex<T, Rest...>::value;
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include <tuple>
+#include <type_traits>
+#include <lsk/lsk_array.h>
+#include "base_entity.h"
+
+#define ORDINATOR_START_CAPACITY 32 // per type, arrays grow when full
+#define ORDINATOR_DESTROY_QUEUE_CAPACITY 16
+
+template<typename ComponentList, typename EntityList>
+struct Ordinator;
+
+/**
+ * Component and entity storage, one lsk_DSparseArray per type
+ * - types are registered with the two type lists, type ids are their constexpr index in them
+ * - every loop is expanded per type at compile time, calls are bound statically
+ * - components and entities are updated in list order
+ * - an entity's components (forEachComponent()) are removed with it
+ * - IEntityBase::destroy() queues the entity, update() only goes through the queues
+ */
+template<typename... Components, typename... Entities>
+struct Ordinator<TypeList<Components...>, TypeList<Entities...>>
+{
+	std::tuple<lsk_DSparseArray<Components>...> _components;
+	std::tuple<lsk_DSparseArray<Entities>...> _entities;
+	lsk_DArray<u32> _destroyQueues[sizeof...(Entities)]; // Ref ids, by entity type id
+
+	template<typename T>
+	static constexpr i32 componentId() {
+		return TypeIndex<T, Components...>::value;
+	}
+
+	template<typename T>
+	static constexpr i32 entityId() {
+		return TypeIndex<T, Entities...>::value;
+	}
+
+	template<typename T>
+	inline lsk_DSparseArray<T>& componentArray() {
+		return std::get<componentId<T>()>(_components);
+	}
+
+	template<typename T>
+	inline lsk_DSparseArray<T>& entityArray() {
+		return std::get<entityId<T>()>(_entities);
+	}
+
+	template<typename T>
+	inline Ref<T> make() {
+		return componentArray<T>().push(T());
+	}
+
+	template<typename T>
+	inline lsk_DArray<u32>& destroyQueue() {
+		return _destroyQueues[entityId<T>()];
+	}
+
+	template<typename T>
+	inline Ref<T> spawn() {
+		Ref<T> ref = entityArray<T>().push(T());
+		ref->_entityId = ref._id;
+		ref->_pDestroyQueue = &destroyQueue<T>();
+		return ref;
+	}
+
+	// immediate, also drops it from the destroy queue
+	template<typename T>
+	void destroy(T& ent) {
+		if(ent._markedAsDestroy) {
+			lsk_DArray<u32>& queue = destroyQueue<T>();
+			for(u32 i = 0; i < queue.count(); ++i) {
+				if(queue[i] == ent._entityId) {
+					// swap-remove by hand, remove() is ambiguous for u32 elements
+					queue[i] = queue[queue.count() - 1];
+					--queue._count;
+					break;
+				}
+			}
+		}
+		_destroy(ent);
+	}
+
+	template<typename T>
+	inline void destroy(Ref<T>& ref) {
+		destroy(ref.get());
+		ref.clear();
+	}
+
+	// per type, arrays grow when full: a game's typical count only saves the first reallocations
+	void init(u32 startCapacity = ORDINATOR_START_CAPACITY) {
+		(componentArray<Components>().init(startCapacity), ...);
+		(entityArray<Entities>().init(startCapacity), ...);
+		(destroyQueue<Entities>().init(ORDINATOR_DESTROY_QUEUE_CAPACITY), ...);
+	}
+
+	void update(f64 delta) {
+		destroyQueued();
+		(updateComponents<Components>(delta), ...);
+		updateEntities(delta);
+	}
+
+	// update() in steps, to be run as systems
+	void destroyQueued() {
+		(_destroyQueued<Entities>(), ...);
+	}
+
+	template<typename T>
+	inline void updateComponents(f64 delta) {
+		_update(componentArray<T>(), delta);
+	}
+
+	void updateEntities(f64 delta) {
+		(_update(entityArray<Entities>(), delta), ...);
+	}
+
+	void destroy() {
+		(_endPlayAll(componentArray<Components>()), ...);
+		(_endPlayAll(entityArray<Entities>()), ...);
+		(destroyQueue<Entities>().destroy(), ...);
+	}
+
+	template<typename T>
+	void _destroy(T& ent) {
+		ent.forEachComponent([this](auto& comp) {
+			_destroyComponent(comp);
+		});
+		ent.endPlay();
+		entityArray<T>().remove(ent);
+	}
+
+	template<typename T>
+	void _destroyQueued() {
+		static_assert(std::is_final<T>::value, "Entity types must be final");
+		static_assert(!std::is_polymorphic<T>::value, "Entity types must not be virtual");
+		lsk_DSparseArray<T>& ents = entityArray<T>();
+		lsk_DArray<u32>& queue = destroyQueue<T>();
+		// popped one by one, endPlay() may queue more
+		while(queue.count() > 0) {
+			const u32 id = queue[queue.count() - 1];
+			--queue._count;
+			_destroy(ents.get(id));
+		}
+	}
+
+	template<typename T>
+	inline void _destroyComponent(Ref<T>& comp) {
+		comp->endPlay();
+		componentArray<T>().remove(comp);
+	}
+
+	template<typename T>
+	static inline void _update(lsk_DSparseArray<T>& elts, f64 delta) {
+		for(auto& elt : elts) {
+			elt.update(delta);
+		}
+	}
+
+	template<typename T>
+	static void _endPlayAll(lsk_DSparseArray<T>& elts) {
+		for(auto& elt : elts) {
+			elt.endPlay();
+		}
+		elts.destroy();
+	}
+};
@@ -1,4 +1,13 @@
 #include "physics.h"
+#include <immintrin.h>
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+#define EMPTY_BOX_MIN 1e30f
+#define EMPTY_BOX_MAX -1e30f
+#define SWEEP_INFINITY 1e30f
+#define SWEEP_TOI_EPSILON 0.01f // already touching, within float error
 
 bool intersectTest(const lsk_AABB2& A, const lsk_AABB2& B, lsk_Vec2* out_pPushVec)
 {
@@ -33,132 +42,2141 @@ bool intersectTest(const lsk_AABB2& A, const lsk_AABB2& B, lsk_Vec2* out_pPushVe
 	return true;
 }
 
-void PhysicsManager::init()
+bool intersectTestFixed(const FixedBox& A, const FixedBox& B, fix32* out_pPushX, fix32* out_pPushY)
 {
-	bodiesDynamic.init(32);
-	bodiesStatic.init(32);
+	// same rules as intersectTest()
+	fix32 d0 = B.maxX - A.minX;
+	fix32 d1 = B.minX - A.maxX;
+	if(d0 < 0 || d1 > 0) {
+		return false;
+	}
+	const fix32 depthX = d0 < -d1 ? d0 : d1;
+
+	d0 = B.maxY - A.minY;
+	d1 = B.minY - A.maxY;
+	if(d0 < 0 || d1 > 0) {
+		return false;
+	}
+	const fix32 depthY = d0 < -d1 ? d0 : d1;
+
+	if(lsk_abs(depthX) < lsk_abs(depthY)) {
+		*out_pPushX = depthX;
+		*out_pPushY = 0;
+	}
+	else {
+		*out_pPushX = 0;
+		*out_pPushY = depthY;
+	}
+	return true;
 }
 
-void PhysicsManager::destroy()
+// murmur3 finalizer, bijective so packed cells never share a key
+static inline u32 gridCellKey(i32 x, i32 y)
 {
-	bodiesDynamic.destroy();
-	bodiesStatic.destroy();
+	u32 h = ((u32)x & 0xffff) | ((u32)y << 16);
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
 }
 
-void PhysicsManager::update(f64 delta)
+void BodyArraySoA::reserve(u32 newCapacity)
 {
-	for(auto& body: bodiesDynamic) {
-		body.vel += gravity;
-		body.box.min += body.vel * delta;
-		body.box.max += body.vel * delta;
-		body.intersecting = false;
+	newCapacity = (newCapacity + PHYSICS_SIMD_WIDTH - 1) & ~(PHYSICS_SIMD_WIDTH - 1);
+	if(newCapacity <= capacity) return;
+
+	lsk_Block newBlock = AllocDefault.allocate(newCapacity * sizeof(f32) * 6, 32);
+	assert_msg(newBlock.ptr, "Out of memory");
+	f32* arrays = (f32*)newBlock.ptr;
+	f32* newMinX = arrays;
+	f32* newMinY = arrays + newCapacity;
+	f32* newMaxX = arrays + newCapacity * 2;
+	f32* newMaxY = arrays + newCapacity * 3;
+	f32* newVelX = arrays + newCapacity * 4;
+	f32* newVelY = arrays + newCapacity * 5;
+
+	if(_block.ptr) {
+		memmove(newMinX, minX, count * sizeof(f32));
+		memmove(newMinY, minY, count * sizeof(f32));
+		memmove(newMaxX, maxX, count * sizeof(f32));
+		memmove(newMaxY, maxY, count * sizeof(f32));
+		memmove(newVelX, velX, count * sizeof(f32));
+		memmove(newVelY, velY, count * sizeof(f32));
+		AllocDefault.deallocate(_block);
 	}
 
-	lsk_DArray<CollisionInfo> collisions(64);
-	bool resolveCollisions = true;
-	for(i32 step = 0; step < 4 && resolveCollisions; ++step) {
-		resolveCollisions = false;
-		collisions.clear();
+	_block = newBlock;
+	minX = newMinX;
+	minY = newMinY;
+	maxX = newMaxX;
+	maxY = newMaxY;
+	velX = newVelX;
+	velY = newVelY;
+	capacity = newCapacity;
+}
+
+void BodyArraySoA::destroy()
+{
+	if(_block.ptr) {
+		AllocDefault.deallocate(_block);
+	}
+	_block = NULL_BLOCK;
+	minX = minY = maxX = maxY = velX = velY = nullptr;
+	count = 0;
+	capacity = 0;
+}
 
-		const i32 dynamicCount = bodiesDynamic.count();
-		const i32 staticCount = bodiesStatic.count();
+void BodyArraySoA::clear()
+{
+	count = 0;
+}
 
-		for(i32 i = 0; i < dynamicCount; ++i) {
-			BodyRectAligned& bodyA = bodiesDynamic.data()[i];
+void BodyArraySoA::push(const lsk_AABB2& box, const lsk_Vec2& vel)
+{
+	if(count >= capacity) {
+		reserve(capacity ? capacity * 2 : PHYSICS_SIMD_WIDTH);
+	}
 
-			for(i32 j = 0; j < staticCount; ++j) {
-				BodyRectAligned& bodyB = bodiesStatic.data()[j];
-				lsk_Vec2 pushVec;
+	minX[count] = box.min.x;
+	minY[count] = box.min.y;
+	maxX[count] = box.max.x;
+	maxY[count] = box.max.y;
+	velX[count] = vel.x;
+	velY[count] = vel.y;
+	++count;
+}
 
-				if(intersectTest(bodyA.box, bodyB.box, &pushVec)) {
-					bodyA.intersecting = true;
+void BodyArraySoA::remove(u32 id)
+{
+	assert(id < count);
+	--count;
+	minX[id] = minX[count];
+	minY[id] = minY[count];
+	maxX[id] = maxX[count];
+	maxY[id] = maxY[count];
+	velX[id] = velX[count];
+	velY[id] = velY[count];
+}
 
-					CollisionInfo coll;
-					coll.pBodyA = &bodyA;
-					coll.pBodyB = &bodyB;
-					coll.boxB_static = true;
-					coll.pushVec = pushVec * 1.0001f; // add a little epsilon
-					collisions.push(coll);
+void BodyArraySoA::copy(const BodyArraySoA& other)
+{
+	reserve(other.count);
+	count = other.count;
+	memmove(minX, other.minX, count * sizeof(f32));
+	memmove(minY, other.minY, count * sizeof(f32));
+	memmove(maxX, other.maxX, count * sizeof(f32));
+	memmove(maxY, other.maxY, count * sizeof(f32));
+	memmove(velX, other.velX, count * sizeof(f32));
+	memmove(velY, other.velY, count * sizeof(f32));
+}
 
-					resolveCollisions = true;
-				}
+void BodyArraySoA::pad(u32 multiple)
+{
+	lsk_AABB2 empty;
+	empty.min = lsk_Vec2(EMPTY_BOX_MIN);
+	empty.max = lsk_Vec2(EMPTY_BOX_MAX);
+	while(count % multiple) {
+		push(empty);
+	}
+}
+
+static inline void pushBatchHits(u32 mask, u32 base, const f32* pushX, const f32* pushY, u32 laneCount,
+								 lsk_DArray<BatchHit>* out)
+{
+	for(u32 l = 0; l < laneCount; ++l) {
+		if(mask & (1 << l)) {
+			BatchHit hit;
+			hit.pushVec = {pushX[l], pushY[l]};
+			hit.index = base + l;
+			out->push(hit);
+		}
+	}
+}
+
+// same operations as intersectTest() lane-wise, so results are bit identical
+// returns the hit mask, push vectors are only written when it is not empty
+static inline u32 intersectLanes4(const lsk_AABB2& A, __m128 minX, __m128 minY, __m128 maxX, __m128 maxY,
+								  f32* pushX, f32* pushY)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signMask = _mm_set1_ps(-0.f);
+
+	__m128 d0 = _mm_sub_ps(maxX, _mm_set1_ps(A.min.x));
+	__m128 d1 = _mm_sub_ps(minX, _mm_set1_ps(A.max.x));
+	__m128 miss = _mm_or_ps(_mm_cmplt_ps(d0, zero), _mm_cmpgt_ps(d1, zero));
+	__m128 sel = _mm_cmplt_ps(d0, _mm_xor_ps(d1, signMask));
+	__m128 depthX = _mm_or_ps(_mm_and_ps(sel, d0), _mm_andnot_ps(sel, d1));
+
+	d0 = _mm_sub_ps(maxY, _mm_set1_ps(A.min.y));
+	d1 = _mm_sub_ps(minY, _mm_set1_ps(A.max.y));
+	miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(d0, zero), _mm_cmpgt_ps(d1, zero)));
+	sel = _mm_cmplt_ps(d0, _mm_xor_ps(d1, signMask));
+	__m128 depthY = _mm_or_ps(_mm_and_ps(sel, d0), _mm_andnot_ps(sel, d1));
+
+	const u32 mask = ~_mm_movemask_ps(miss) & 0xf;
+	if(mask) {
+		__m128 useX = _mm_cmplt_ps(_mm_mul_ps(depthX, depthX), _mm_mul_ps(depthY, depthY));
+		_mm_store_ps(pushX, _mm_and_ps(useX, depthX));
+		_mm_store_ps(pushY, _mm_andnot_ps(useX, depthY));
+	}
+	return mask;
+}
+
+void intersectTestBatch(const lsk_AABB2& A, const BodyArraySoA& boxes, u32 start, u32 count,
+						lsk_DArray<BatchHit>* out)
+{
+	const u32 end = start + ((count + 3) & ~3);
+	assert(end <= boxes.capacity);
+	u32 i = start;
+
+#ifdef __AVX2__
+	{
+		const __m256 aMinX = _mm256_set1_ps(A.min.x);
+		const __m256 aMinY = _mm256_set1_ps(A.min.y);
+		const __m256 aMaxX = _mm256_set1_ps(A.max.x);
+		const __m256 aMaxY = _mm256_set1_ps(A.max.y);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 signMask = _mm256_set1_ps(-0.f);
+		alignas(32) f32 pushX[8];
+		alignas(32) f32 pushY[8];
+
+		for(; i + 8 <= end; i += 8) {
+			__m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(boxes.maxX + i), aMinX);
+			__m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(boxes.minX + i), aMaxX);
+			__m256 miss = _mm256_or_ps(_mm256_cmp_ps(d0, zero, _CMP_LT_OQ), _mm256_cmp_ps(d1, zero, _CMP_GT_OQ));
+			__m256 sel = _mm256_cmp_ps(d0, _mm256_xor_ps(d1, signMask), _CMP_LT_OQ);
+			__m256 depthX = _mm256_or_ps(_mm256_and_ps(sel, d0), _mm256_andnot_ps(sel, d1));
+
+			d0 = _mm256_sub_ps(_mm256_loadu_ps(boxes.maxY + i), aMinY);
+			d1 = _mm256_sub_ps(_mm256_loadu_ps(boxes.minY + i), aMaxY);
+			miss = _mm256_or_ps(miss, _mm256_or_ps(_mm256_cmp_ps(d0, zero, _CMP_LT_OQ),
+												  _mm256_cmp_ps(d1, zero, _CMP_GT_OQ)));
+			sel = _mm256_cmp_ps(d0, _mm256_xor_ps(d1, signMask), _CMP_LT_OQ);
+			__m256 depthY = _mm256_or_ps(_mm256_and_ps(sel, d0), _mm256_andnot_ps(sel, d1));
+
+			u32 mask = ~_mm256_movemask_ps(miss) & 0xff;
+			if(!mask) continue;
+
+			__m256 useX = _mm256_cmp_ps(_mm256_mul_ps(depthX, depthX), _mm256_mul_ps(depthY, depthY),
+										_CMP_LT_OQ);
+			_mm256_store_ps(pushX, _mm256_and_ps(useX, depthX));
+			_mm256_store_ps(pushY, _mm256_andnot_ps(useX, depthY));
+			pushBatchHits(mask, i, pushX, pushY, 8, out);
+		}
+	}
+#endif
+
+	alignas(16) f32 pushX[4];
+	alignas(16) f32 pushY[4];
+	for(; i < end; i += 4) {
+		const u32 mask = intersectLanes4(A, _mm_loadu_ps(boxes.minX + i), _mm_loadu_ps(boxes.minY + i),
+										 _mm_loadu_ps(boxes.maxX + i), _mm_loadu_ps(boxes.maxY + i), pushX, pushY);
+		if(mask) {
+			pushBatchHits(mask, i, pushX, pushY, 4, out);
+		}
+	}
+}
+
+void intersectTestGather(const lsk_AABB2& A, const BodyArraySoA& boxes, const u32* ids, u32 count,
+						 lsk_DArray<BatchHit>* out)
+{
+	alignas(16) f32 pushX[4];
+	alignas(16) f32 pushY[4];
+	for(u32 c = 0; c < count; c += 4) {
+		// a partial group repeats its last id, the extra lanes are masked out
+		const u32 laneCount = lsk_min(count - c, 4u);
+		u32 lane[4];
+		for(u32 l = 0; l < 4; ++l) {
+			lane[l] = ids[c + lsk_min(l, laneCount - 1)];
+		}
+
+		u32 mask = intersectLanes4(A,
+			_mm_setr_ps(boxes.minX[lane[0]], boxes.minX[lane[1]], boxes.minX[lane[2]], boxes.minX[lane[3]]),
+			_mm_setr_ps(boxes.minY[lane[0]], boxes.minY[lane[1]], boxes.minY[lane[2]], boxes.minY[lane[3]]),
+			_mm_setr_ps(boxes.maxX[lane[0]], boxes.maxX[lane[1]], boxes.maxX[lane[2]], boxes.maxX[lane[3]]),
+			_mm_setr_ps(boxes.maxY[lane[0]], boxes.maxY[lane[1]], boxes.maxY[lane[2]], boxes.maxY[lane[3]]),
+			pushX, pushY);
+		mask &= (1u << laneCount) - 1;
+
+		for(u32 l = 0; l < laneCount; ++l) {
+			if(mask & (1 << l)) {
+				BatchHit hit;
+				hit.pushVec = {pushX[l], pushY[l]};
+				hit.index = lane[l];
+				out->push(hit);
 			}
+		}
+	}
+}
+
+// vel += gravity * scale, box += vel * delta
+// scale is 1 or 0 per lane (sleeping bodies have no velocity and stay in place), readable up to end
+static void integrateBatch(BodyArraySoA& bodies, const f32* scale, const lsk_Vec2& gravity, f32 delta)
+{
+	const u32 end = (bodies.count + 3) & ~3;
+	u32 i = 0;
+
+#ifdef __AVX2__
+	{
+		const __m256 gx = _mm256_set1_ps(gravity.x);
+		const __m256 gy = _mm256_set1_ps(gravity.y);
+		const __m256 dt = _mm256_set1_ps(delta);
+		for(; i + 8 <= end; i += 8) {
+			const __m256 s = _mm256_loadu_ps(scale + i);
+			__m256 vx = _mm256_add_ps(_mm256_load_ps(bodies.velX + i), _mm256_mul_ps(gx, s));
+			__m256 vy = _mm256_add_ps(_mm256_load_ps(bodies.velY + i), _mm256_mul_ps(gy, s));
+			__m256 mx = _mm256_mul_ps(vx, dt);
+			__m256 my = _mm256_mul_ps(vy, dt);
+			_mm256_store_ps(bodies.velX + i, vx);
+			_mm256_store_ps(bodies.velY + i, vy);
+			_mm256_store_ps(bodies.minX + i, _mm256_add_ps(_mm256_load_ps(bodies.minX + i), mx));
+			_mm256_store_ps(bodies.minY + i, _mm256_add_ps(_mm256_load_ps(bodies.minY + i), my));
+			_mm256_store_ps(bodies.maxX + i, _mm256_add_ps(_mm256_load_ps(bodies.maxX + i), mx));
+			_mm256_store_ps(bodies.maxY + i, _mm256_add_ps(_mm256_load_ps(bodies.maxY + i), my));
+		}
+	}
+#endif
+
+	const __m128 gx = _mm_set1_ps(gravity.x);
+	const __m128 gy = _mm_set1_ps(gravity.y);
+	const __m128 dt = _mm_set1_ps(delta);
+	for(; i < end; i += 4) {
+		const __m128 s = _mm_loadu_ps(scale + i);
+		__m128 vx = _mm_add_ps(_mm_load_ps(bodies.velX + i), _mm_mul_ps(gx, s));
+		__m128 vy = _mm_add_ps(_mm_load_ps(bodies.velY + i), _mm_mul_ps(gy, s));
+		__m128 mx = _mm_mul_ps(vx, dt);
+		__m128 my = _mm_mul_ps(vy, dt);
+		_mm_store_ps(bodies.velX + i, vx);
+		_mm_store_ps(bodies.velY + i, vy);
+		_mm_store_ps(bodies.minX + i, _mm_add_ps(_mm_load_ps(bodies.minX + i), mx));
+		_mm_store_ps(bodies.minY + i, _mm_add_ps(_mm_load_ps(bodies.minY + i), my));
+		_mm_store_ps(bodies.maxX + i, _mm_add_ps(_mm_load_ps(bodies.maxX + i), mx));
+		_mm_store_ps(bodies.maxY + i, _mm_add_ps(_mm_load_ps(bodies.maxY + i), my));
+	}
+}
 
-			for(i32 j = 0; j < dynamicCount; ++j) {
-				if(i == j) continue;
-				BodyRectAligned& bodyB = bodiesDynamic.data()[j];
-				if(bodyA.group != -1 && bodyB.group == bodyA.group) continue;
-				lsk_Vec2 pushVec;
+// clamped so far away bodies stay addressable with 16bit cell keys
+static inline i32 gridCoord(f32 v, f32 cellSize)
+{
+	return (i32)lsk_clamp(floorf(v / cellSize), (f32)-I16_MAX, (f32)I16_MAX);
+}
 
-				if(intersectTest(bodyA.box, bodyB.box, &pushVec)) {
-					bodyA.intersecting = true;
-					bodyB.intersecting = true;
+// sorts and removes duplicates (candidate lists are small)
+static u32 sortUnique(u32* ids, u32 count)
+{
+	for(u32 i = 1; i < count; ++i) {
+		u32 v = ids[i];
+		i32 j = i - 1;
+		while(j >= 0 && ids[j] > v) {
+			ids[j + 1] = ids[j];
+			--j;
+		}
+		ids[j + 1] = v;
+	}
 
-					CollisionInfo coll;
-					coll.pBodyA = &bodyA;
-					coll.pBodyB = &bodyB;
-					coll.boxB_static = false;
-					coll.pushVec = pushVec * 1.0001f; // add a little epsilon
-					collisions.push(coll);
+	u32 uniqueCount = 0;
+	for(u32 i = 0; i < count; ++i) {
+		if(uniqueCount == 0 || ids[uniqueCount - 1] != ids[i]) {
+			ids[uniqueCount++] = ids[i];
+		}
+	}
+	return uniqueCount;
+}
 
-					resolveCollisions = true;
-				}
+static void sortHits(BatchHit* hits, u32 count)
+{
+	for(u32 i = 1; i < count; ++i) {
+		BatchHit v = hits[i];
+		i32 j = i - 1;
+		while(j >= 0 && hits[j].index > v.index) {
+			hits[j + 1] = hits[j];
+			--j;
+		}
+		hits[j + 1] = v;
+	}
+}
+
+void BroadphaseGrid::init(u32 capacity, f32 cellSize)
+{
+	_cellSize = cellSize;
+	_cellHead.init(capacity * 4);
+	_nodes.init(capacity * 4);
+	_freeNode = -1;
+}
+
+void BroadphaseGrid::destroy()
+{
+	_cellHead.destroy();
+	_nodes.destroy();
+	_freeNode = -1;
+}
+
+GridRect BroadphaseGrid::computeRect(const lsk_AABB2& box) const
+{
+	// floor is monotonic: touching boxes always share at least one cell
+	GridRect rect;
+	rect.minX = gridCoord(box.min.x, _cellSize);
+	rect.minY = gridCoord(box.min.y, _cellSize);
+	rect.maxX = gridCoord(box.max.x, _cellSize);
+	rect.maxY = gridCoord(box.max.y, _cellSize);
+	return rect;
+}
+
+void BroadphaseGrid::_insertCell(u32 id, i32 x, i32 y)
+{
+	i32 nodeId = _freeNode;
+	if(nodeId != -1) {
+		_freeNode = _nodes[nodeId].next;
+	}
+	else {
+		nodeId = _nodes.count();
+		_nodes.push(Node());
+	}
+
+	const u32 key = gridCellKey(x, y);
+	i32* pHead = _cellHead.geth(key);
+	_nodes[nodeId].id = id;
+
+	// seth only on missing keys, it could insert a duplicate after a removeh
+	if(pHead) {
+		_nodes[nodeId].next = *pHead;
+		*pHead = nodeId;
+	}
+	else {
+		_nodes[nodeId].next = -1;
+		_cellHead.seth(key, nodeId);
+	}
+}
+
+void BroadphaseGrid::_removeCell(u32 id, i32 x, i32 y)
+{
+	const u32 key = gridCellKey(x, y);
+	i32* pHead = _cellHead.geth(key);
+	assert_msg(pHead, "BroadphaseGrid::_removeCell() cell not found");
+
+	i32* pLink = pHead;
+	while(*pLink != -1 && _nodes[*pLink].id != id) {
+		pLink = &_nodes[*pLink].next;
+	}
+	assert_msg(*pLink != -1, "BroadphaseGrid::_removeCell() id not found");
+
+	i32 nodeId = *pLink;
+	*pLink = _nodes[nodeId].next;
+	_nodes[nodeId].next = _freeNode;
+	_freeNode = nodeId;
+
+	if(*pHead == -1) {
+		_cellHead.removeh(key);
+	}
+}
+
+void BroadphaseGrid::insert(u32 id, const GridRect& rect)
+{
+	for(i32 y = rect.minY; y <= rect.maxY; ++y) {
+		for(i32 x = rect.minX; x <= rect.maxX; ++x) {
+			_insertCell(id, x, y);
+		}
+	}
+}
+
+void BroadphaseGrid::remove(u32 id, const GridRect& rect)
+{
+	for(i32 y = rect.minY; y <= rect.maxY; ++y) {
+		for(i32 x = rect.minX; x <= rect.maxX; ++x) {
+			_removeCell(id, x, y);
+		}
+	}
+}
+
+void BroadphaseGrid::move(u32 id, const GridRect& oldRect, const GridRect& newRect)
+{
+	// only touch the cells that changed
+	for(i32 y = oldRect.minY; y <= oldRect.maxY; ++y) {
+		for(i32 x = oldRect.minX; x <= oldRect.maxX; ++x) {
+			if(!newRect.contains(x, y)) {
+				_removeCell(id, x, y);
 			}
 		}
+	}
 
-		for(auto& coll: collisions) {
-			if(coll.boxB_static) {
-				coll.pBodyA->box.min += coll.pushVec;
-				coll.pBodyA->box.max += coll.pushVec;
+	for(i32 y = newRect.minY; y <= newRect.maxY; ++y) {
+		for(i32 x = newRect.minX; x <= newRect.maxX; ++x) {
+			if(!oldRect.contains(x, y)) {
+				_insertCell(id, x, y);
+			}
+		}
+	}
+}
 
-				if(coll.pushVec.x != 0) {
-					coll.pBodyA->x_locked = true;
-					coll.pBodyA->vel.x = 0;
-				}
-				if(coll.pushVec.y != 0) {
-					coll.pBodyA->y_locked = true;
-					coll.pBodyA->vel.y = 0;
-				}
+void BroadphaseGrid::query(const GridRect& rect, lsk_DArray<u32>* out) const
+{
+	for(i32 y = rect.minY; y <= rect.maxY; ++y) {
+		for(i32 x = rect.minX; x <= rect.maxX; ++x) {
+			const i32* pHead = _cellHead.geth(gridCellKey(x, y));
+			if(!pHead) continue;
+
+			for(i32 n = *pHead; n != -1; n = _nodes[n].next) {
+				out->push(_nodes[n].id);
 			}
-			else {
-				if(!coll.pBodyA->x_locked) {
-					coll.pBodyA->box.min.x += coll.pushVec.x / 2.f;
-					coll.pBodyA->box.max.x += coll.pushVec.x / 2.f;
-				}
-				else {
-					coll.pBodyB->box.min.x += -coll.pushVec.x;
-					coll.pBodyB->box.max.x += -coll.pushVec.x;
-				}
+		}
+	}
+}
 
-				if(!coll.pBodyA->y_locked) {
-					coll.pBodyA->box.min.y += coll.pushVec.y / 2.f;
-					coll.pBodyA->box.max.y += coll.pushVec.y / 2.f;
-				}
-				else {
-					coll.pBodyB->box.min.y += -coll.pushVec.y;
-					coll.pBodyB->box.max.y += -coll.pushVec.y;
-				}
+void StaticTree::init(u32 capacity)
+{
+	_nodes.init(capacity);
+	_items.init(capacity);
+}
 
-				if(!coll.pBodyB->x_locked) {
-					coll.pBodyB->box.min.x += -coll.pushVec.x / 2.f;
-					coll.pBodyB->box.max.x +=- coll.pushVec.x / 2.f;
-				}
-				if(!coll.pBodyB->y_locked) {
-					coll.pBodyB->box.min.y += -coll.pushVec.y / 2.f;
-					coll.pBodyB->box.max.y += -coll.pushVec.y / 2.f;
-				}
+void StaticTree::destroy()
+{
+	_nodes.destroy();
+	_items.destroy();
+	_boxes.destroy();
+}
 
-				if(coll.pushVec.x != 0) {
-					coll.pBodyA->vel.x = 0;
-					coll.pBodyB->vel.x = 0;
-				}
-				if(coll.pushVec.y != 0) {
-					coll.pBodyA->vel.y = 0;
-					coll.pBodyB->vel.y = 0;
-				}
+static i32 compareBuildItemX(const void* pa, const void* pb)
+{
+	const StaticTree::BuildItem& a = *(const StaticTree::BuildItem*)pa;
+	const StaticTree::BuildItem& b = *(const StaticTree::BuildItem*)pb;
+	if(a.cx < b.cx) return -1;
+	if(a.cx > b.cx) return 1;
+	return (i32)a.id - (i32)b.id;
+}
+
+static i32 compareBuildItemY(const void* pa, const void* pb)
+{
+	const StaticTree::BuildItem& a = *(const StaticTree::BuildItem*)pa;
+	const StaticTree::BuildItem& b = *(const StaticTree::BuildItem*)pb;
+	if(a.cy < b.cy) return -1;
+	if(a.cy > b.cy) return 1;
+	return (i32)a.id - (i32)b.id;
+}
+
+void StaticTree::build(const lsk_DSparseArray<BodyRectAligned>& bodies)
+{
+	_nodes.clear();
+	_items.clear();
+	_boxes.clear();
+
+	const u32 count = bodies.count();
+	if(count == 0) return;
+
+	lsk_Block itemsBlock = AllocDefault.allocate(count * sizeof(BuildItem), alignof(BuildItem));
+	assert_msg(itemsBlock.ptr, "Out of memory");
+	BuildItem* items = (BuildItem*)itemsBlock.ptr;
+
+	for(u32 i = 0; i < count; ++i) {
+		const lsk_AABB2& box = bodies.data(i).box;
+		items[i].cx = (box.min.x + box.max.x) * 0.5f;
+		items[i].cy = (box.min.y + box.max.y) * 0.5f;
+		items[i].id = i;
+	}
+
+	_nodes.reserve(count * 2 / STATIC_TREE_LEAF_SIZE + 1);
+	_items.reserve(count);
+	_boxes.reserve(count);
+	_buildNode(bodies, items, count);
+
+	AllocDefault.deallocate(itemsBlock);
+}
+
+void StaticTree::_buildNode(const lsk_DSparseArray<BodyRectAligned>& bodies, BuildItem* items, u32 count)
+{
+	const i32 nodeId = _nodes.count();
+	Node node;
+	node.minX = node.minY = 1e30f;
+	node.maxX = node.maxY = -1e30f;
+	f32 cminX = 1e30f, cminY = 1e30f, cmaxX = -1e30f, cmaxY = -1e30f;
+
+	for(u32 i = 0; i < count; ++i) {
+		const lsk_AABB2& box = bodies.data(items[i].id).box;
+		node.minX = lsk_min(node.minX, box.min.x);
+		node.minY = lsk_min(node.minY, box.min.y);
+		node.maxX = lsk_max(node.maxX, box.max.x);
+		node.maxY = lsk_max(node.maxY, box.max.y);
+		cminX = lsk_min(cminX, items[i].cx);
+		cminY = lsk_min(cminY, items[i].cy);
+		cmaxX = lsk_max(cmaxX, items[i].cx);
+		cmaxY = lsk_max(cmaxY, items[i].cy);
+	}
+
+	node.escape = -1;
+	node.first = 0;
+	node.count = 0;
+	node._pad = 0;
+
+	if(count <= STATIC_TREE_LEAF_SIZE) {
+		node.first = _items.count();
+		node.count = count;
+		for(u32 i = 0; i < count; ++i) {
+			_items.push(items[i].id);
+			_boxes.push(bodies.data(items[i].id).box);
+		}
+
+		// leaves are padded so the batch test always reads full lanes
+		while(_items.count() % STATIC_TREE_LEAF_SIZE) {
+			_items.push((u32)-1);
+		}
+		_boxes.pad(STATIC_TREE_LEAF_SIZE);
+		_nodes.push(node);
+		_nodes[nodeId].escape = _nodes.count();
+		return;
+	}
+
+	_nodes.push(node);
+
+	// median split on the longest centroid axis
+	if(cmaxX - cminX >= cmaxY - cminY) {
+		qsort(items, count, sizeof(BuildItem), compareBuildItemX);
+	}
+	else {
+		qsort(items, count, sizeof(BuildItem), compareBuildItemY);
+	}
+
+	const u32 half = count / 2;
+	_buildNode(bodies, items, half);
+	_buildNode(bodies, items + half, count - half);
+	_nodes[nodeId].escape = _nodes.count();
+}
+
+void StaticTree::query(const lsk_AABB2& box, lsk_DArray<u32>* out) const
+{
+	const i32 nodeCount = _nodes.count();
+	const Node* nodes = _nodes.data();
+	const u32* items = _items.data();
+
+	i32 n = 0;
+	while(n < nodeCount) {
+		const Node& node = nodes[n];
+		// same overlap rule as intersectTest: touching counts
+		if(node.maxX < box.min.x || node.minX > box.max.x ||
+		   node.maxY < box.min.y || node.minY > box.max.y) {
+			n = node.escape;
+			continue;
+		}
+
+		for(i32 i = 0; i < node.count; ++i) {
+			out->push(items[node.first + i]);
+		}
+		++n;
+	}
+}
+
+void StaticTree::queryIntersect(const lsk_AABB2& box, lsk_DArray<BatchHit>* out) const
+{
+	const i32 nodeCount = _nodes.count();
+	const Node* nodes = _nodes.data();
+
+	i32 n = 0;
+	while(n < nodeCount) {
+		const Node& node = nodes[n];
+		if(node.maxX < box.min.x || node.minX > box.max.x ||
+		   node.maxY < box.min.y || node.minY > box.max.y) {
+			n = node.escape;
+			continue;
+		}
+
+		if(node.count > 0) {
+			const u32 first = out->count();
+			intersectTestBatch(box, _boxes, node.first, node.count, out);
+			for(u32 h = first; h < out->count(); ++h) {
+				(*out)[h].index = _items[(*out)[h].index];
 			}
 		}
+		++n;
+	}
+}
 
-		//lsk_printf("step=%d", step);
+void NarrowphaseScratch::init()
+{
+	candidates.init(64);
+	hits.init(64);
+	contacts.init(64);
+}
+
+void NarrowphaseScratch::destroy()
+{
+	candidates.destroy();
+	hits.destroy();
+	contacts.destroy();
+}
+
+void PhysicsManager::init()
+{
+	bodiesDynamic.init(32);
+	bodiesStatic.init(32);
+	bodiesKinematic.init(16);
+	_gridKinematic.init(16);
+	_staticTree.init(64);
+	_staticTreeDirty = true;
+	_staticChanged = false;
+	_dynamicSoA.reserve(32);
+	_kinematicSoA.reserve(16);
+	_broadDynamic.init(32);
+	_broadKinematic.init(16);
+	_sleepDynamic.init(32);
+	_fixDynamic.init(32);
+	_fixStatic.init(32);
+	_fixKinematic.init(16);
+	for(u32 t = 0; t < JOBS_MAX_THREADS; ++t) {
+		_scratch[t].init();
+	}
+	_stepIds.init(32);
+	_gravityScale.init(32);
+	_awakeIds.init(32);
+	_islandParent.init(32);
+	_islandFlags.init(32);
+}
+
+void PhysicsManager::destroy()
+{
+	bodiesDynamic.destroy();
+	bodiesStatic.destroy();
+	bodiesKinematic.destroy();
+	for(u32 l = 0; l < PHYSICS_MAX_LAYERS; ++l) {
+		if(_dynamicLayers & (1u << l)) {
+			_gridDynamic[l].destroy();
+		}
 	}
+	_dynamicLayers = 0;
+	_gridKinematic.destroy();
+	_staticTree.destroy();
+	_dynamicSoA.destroy();
+	_kinematicSoA.destroy();
+	_broadDynamic.destroy();
+	_broadKinematic.destroy();
+	_sleepDynamic.destroy();
+	_fixDynamic.destroy();
+	_fixStatic.destroy();
+	_fixKinematic.destroy();
+	for(u32 t = 0; t < JOBS_MAX_THREADS; ++t) {
+		_scratch[t].destroy();
+	}
+	_stepIds.destroy();
+	_gravityScale.destroy();
+	_sweepStart.destroy();
+	_awakeIds.destroy();
+	_islandParent.destroy();
+	_islandFlags.destroy();
+}
+
+static inline i32 layerIndex(u32 layer)
+{
+	assert(layer != 0 && (layer & (layer - 1)) == 0); // one layer per body
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, layer);
+	return (i32)index;
+#else
+	return __builtin_ctz(layer);
+#endif
+}
+
+// every layer grid uses the default cell size
+static inline GridRect layerGridRect(const lsk_AABB2& box)
+{
+	GridRect rect;
+	rect.minX = gridCoord(box.min.x, PHYSICS_GRID_CELL_SIZE);
+	rect.minY = gridCoord(box.min.y, PHYSICS_GRID_CELL_SIZE);
+	rect.maxX = gridCoord(box.max.x, PHYSICS_GRID_CELL_SIZE);
+	rect.maxY = gridCoord(box.max.y, PHYSICS_GRID_CELL_SIZE);
+	return rect;
+}
+
+// side arrays follow the body array: pushed at the same data id, swap-removed the same way
+Ref<BodyRectAligned> PhysicsManager::addDynamic(const BodyRectAligned& body)
+{
+	Ref<BodyRectAligned> ref = bodiesDynamic.push(body);
+	_dynamicSoA.push(body.box, body.vel);
+	_broadDynamic.push(BodyBroadphase());
+	_sleepDynamic.push(BodySleep());
+	_fixDynamic.push(BodyFixed());
+
+	// in its layer grid right away, queries find it before the next update
+	const i32 layer = layerIndex(body.layer);
+	if(!(_dynamicLayers & (1u << layer))) {
+		_gridDynamic[layer].init(32);
+		_dynamicLayers |= 1u << layer;
+	}
+	BodyBroadphase& broad = _broadDynamic[_broadDynamic.count() - 1];
+	broad.layer = layer;
+	broad.rect = layerGridRect(body.box);
+	_gridDynamic[layer].insert(ref._id, broad.rect);
+	return ref;
+}
+
+Ref<BodyRectAligned> PhysicsManager::addStatic(const BodyRectAligned& body)
+{
+	// static tree is rebuilt on next update or query, add static bodies at load time
+	_staticTreeDirty = true;
+	_staticChanged = true;
+	_fixStatic.push(BodyFixed());
+	return bodiesStatic.push(body);
+}
+
+Ref<BodyRectAligned> PhysicsManager::addKinematic(const BodyRectAligned& body)
+{
+	// the empty solver box differs from any real one, next update syncs it and wakes what it overlaps
+	lsk_AABB2 empty;
+	empty.min = lsk_Vec2(EMPTY_BOX_MIN);
+	empty.max = lsk_Vec2(EMPTY_BOX_MAX);
+	_kinematicSoA.push(empty);
+	_fixKinematic.push(BodyFixed());
+	Ref<BodyRectAligned> ref = bodiesKinematic.push(body);
+
+	// in the grid right away, queries find it before the next update
+	BodyBroadphase& broad = _broadKinematic.push(BodyBroadphase());
+	broad.rect = _gridKinematic.computeRect(body.box);
+	_gridKinematic.insert(ref._id, broad.rect);
+	return ref;
+}
+
+void PhysicsManager::removeDynamic(Ref<BodyRectAligned>& ref)
+{
+	// bodies sleeping on this one would float
+	wake(ref.get());
+	const u32 did = bodiesDynamic.dataId(ref._id);
+	const BodyBroadphase& broad = _broadDynamic[did];
+	if(broad.layer != -1) {
+		_gridDynamic[broad.layer].remove(ref._id, broad.rect);
+	}
+	_dynamicSoA.remove(did);
+	_broadDynamic.remove(did);
+	_sleepDynamic.remove(did);
+	_fixDynamic.remove(did);
+	bodiesDynamic.remove(ref);
+}
+
+void PhysicsManager::removeStatic(Ref<BodyRectAligned>& ref)
+{
+	_staticTreeDirty = true;
+	_staticChanged = true;
+	_fixStatic.remove(bodiesStatic.dataId(ref._id));
+	bodiesStatic.remove(ref);
+}
+
+void PhysicsManager::removeKinematic(Ref<BodyRectAligned>& ref)
+{
+	const u32 did = bodiesKinematic.dataId(ref._id);
+	_gridKinematic.remove(ref._id, _broadKinematic[did].rect);
+	_kinematicSoA.remove(did);
+	_broadKinematic.remove(did);
+	_fixKinematic.remove(did);
+	bodiesKinematic.remove(ref);
+}
+
+void PhysicsManager::_syncGrid(const lsk_DSparseArray<BodyRectAligned>& bodies, BroadphaseGrid& grid,
+							   lsk_DArray<BodyBroadphase>& broad)
+{
+	const i32 count = bodies.count();
+	for(i32 i = 0; i < count; ++i) {
+		GridRect rect = grid.computeRect(bodies.data(i).box);
+		if(rect != broad[i].rect) {
+			grid.move(bodies.refId(i), broad[i].rect, rect);
+			broad[i].rect = rect;
+		}
+	}
+}
+
+void PhysicsManager::_syncLayerGrids()
+{
+	const i32 count = bodiesDynamic.count();
+	for(i32 i = 0; i < count; ++i) {
+		BodyBroadphase& broad = _broadDynamic[i];
+		const i32 layer = layerIndex(bodiesDynamic.data()[i].layer);
+		BroadphaseGrid& grid = _gridDynamic[layer];
+		if(!(_dynamicLayers & (1u << layer))) {
+			grid.init(32);
+			_dynamicLayers |= 1u << layer;
+		}
+
+		GridRect rect = layerGridRect(_dynamicSoA.box(i));
+		if(layer != broad.layer) {
+			// gameplay code changed the layer
+			if(broad.layer != -1) {
+				_gridDynamic[broad.layer].remove(bodiesDynamic.refId(i), broad.rect);
+			}
+			grid.insert(bodiesDynamic.refId(i), rect);
+			broad.layer = layer;
+			broad.rect = rect;
+		}
+		else if(rect != broad.rect) {
+			grid.move(bodiesDynamic.refId(i), broad.rect, rect);
+			broad.rect = rect;
+		}
+	}
+}
+
+u32 PhysicsManager::_queryDynamic(NarrowphaseScratch& scratch, u32 layerMask, const GridRect& rect) const
+{
+	scratch.candidates.clear();
+	u32 layers = layerMask & _dynamicLayers;
+	while(layers) {
+		const i32 layer = layerIndex(layers & (~layers + 1));
+		layers &= layers - 1;
+		_gridDynamic[layer].query(rect, &scratch.candidates);
+	}
+
+	const u32 count = scratch.candidates.count();
+	u32* ids = scratch.candidates.data();
+	for(u32 c = 0; c < count; ++c) {
+		ids[c] = bodiesDynamic.dataId(ids[c]);
+	}
+	return sortUnique(ids, count);
+}
+
+u32 PhysicsManager::_queryCandidates(NarrowphaseScratch& scratch, const lsk_DSparseArray<BodyRectAligned>& bodies,
+									 const BroadphaseGrid& grid, const GridRect& rect) const
+{
+	scratch.candidates.clear();
+	grid.query(rect, &scratch.candidates);
+
+	// ref ids -> data ids, sorted to test pairs in the same order as a full scan
+	const u32 count = scratch.candidates.count();
+	u32* ids = scratch.candidates.data();
+	for(u32 c = 0; c < count; ++c) {
+		ids[c] = bodies.dataId(ids[c]);
+	}
+	return sortUnique(ids, count);
+}
+
+u32 PhysicsManager::_queryStaticHits(NarrowphaseScratch& scratch, const lsk_AABB2& box) const
+{
+	scratch.hits.clear();
+	_staticTree.queryIntersect(box, &scratch.hits);
+	sortHits(scratch.hits.data(), scratch.hits.count());
+	return scratch.hits.count();
+}
+
+u32 PhysicsManager::_queryHits(NarrowphaseScratch& scratch, const BodyArraySoA& soa, const lsk_AABB2& box,
+							   u32 candidateCount) const
+{
+	// candidates are data ids, the solver boxes are read in place
+	scratch.hits.clear();
+	intersectTestGather(box, soa, scratch.candidates.data(), candidateCount, &scratch.hits);
+	return scratch.hits.count();
+}
+
+// one-way bodies only push up bodies that were above them at the start of the tick
+static inline bool oneWayAccept(const lsk_AABB2& box, const lsk_Vec2& restPos, const BodyRectAligned& platform,
+								const lsk_Vec2& pushVec)
+{
+	if(!platform.oneWay) {
+		return true;
+	}
+	const f32 startBottom = restPos.y + (box.max.y - box.min.y);
+	return pushVec.y < 0 && startBottom <= platform.box.min.y + PHYSICS_ONE_WAY_TOLERANCE;
+}
+
+static void addContact(i32 idA, i32 idB, const lsk_Vec2& pushVec, bool boxB_static,
+					   lsk_DArray<CollisionInfo>* contacts)
+{
+	CollisionInfo coll;
+	coll.idA = idA;
+	coll.idB = idB;
+	coll.boxB_static = boxB_static;
+	coll.pushVec = pushVec * 1.0001f; // add a little epsilon
+	contacts->push(coll);
+}
+
+void PhysicsManager::_narrowphase(NarrowphaseScratch& scratch, i32 i)
+{
+	// only reads bodies, contacts are applied in _mergeContacts()
+	const BodyRectAligned& bodyA = bodiesDynamic.data()[i];
+	const lsk_AABB2 boxA = _dynamicSoA.box(i);
+	const lsk_Vec2 restPos = _sleepDynamic[i].restPos;
+	const GridRect& rectA = _broadDynamic[i].rect;
+
+	u32 hitCount = _queryStaticHits(scratch, boxA);
+	for(u32 h = 0; h < hitCount; ++h) {
+		const u32 j = scratch.hits[h].index;
+		const BodyRectAligned& bodyB = bodiesStatic.data()[j];
+		if(layersInteract(bodyA, bodyB) && oneWayAccept(boxA, restPos, bodyB, scratch.hits[h].pushVec)) {
+			addContact(i, j, scratch.hits[h].pushVec, true, &scratch.contacts);
+		}
+	}
+
+	u32 candidateCount = _queryCandidates(scratch, bodiesKinematic, _gridKinematic, rectA);
+	hitCount = _queryHits(scratch, _kinematicSoA, boxA, candidateCount);
+	for(u32 h = 0; h < hitCount; ++h) {
+		const u32 j = scratch.hits[h].index;
+		const BodyRectAligned& bodyB = bodiesKinematic.data()[j];
+		if(layersInteract(bodyA, bodyB) && oneWayAccept(boxA, restPos, bodyB, scratch.hits[h].pushVec)) {
+			addContact(i, j, scratch.hits[h].pushVec, true, &scratch.contacts);
+		}
+	}
+
+	// only the buckets of layers in A's mask are enumerated
+	candidateCount = _queryDynamic(scratch, bodyA.mask, rectA);
+
+	// filter self and one-sided masks before the batch test
+	u32 kept = 0;
+	for(u32 c = 0; c < candidateCount; ++c) {
+		const i32 j = scratch.candidates[c];
+		if(i == j) continue;
+		const BodyRectAligned& bodyB = bodiesDynamic.data()[j];
+		if(!(bodyB.mask & bodyA.layer)) continue;
+		scratch.candidates[kept++] = j;
+	}
+
+	hitCount = _queryHits(scratch, _dynamicSoA, boxA, kept);
+	for(u32 h = 0; h < hitCount; ++h) {
+		addContact(i, scratch.hits[h].index, scratch.hits[h].pushVec, false, &scratch.contacts);
+	}
+}
+
+static void narrowphaseJob(void* pUserData, u32 begin, u32 end, u32 threadId)
+{
+	PhysicsManager& pm = *(PhysicsManager*)pUserData;
+	NarrowphaseScratch& scratch = pm._scratch[threadId];
+	scratch.contacts.clear();
+	for(u32 s = begin; s < end; ++s) {
+		if(pm.fixedPoint) {
+			pm._narrowphaseFixed(scratch, pm._stepIds[s]);
+		}
+		else {
+			pm._narrowphase(scratch, pm._stepIds[s]);
+		}
+	}
+}
+
+void PhysicsManager::_mergeContacts(u32 threadCount, lsk_DArray<CollisionInfo>* collisions)
+{
+	// thread chunks are contiguous, thread order is the serial order
+	for(u32 t = 0; t < threadCount; ++t) {
+		for(auto& coll: _scratch[t].contacts) {
+			bodiesDynamic.data()[coll.idA].intersecting = true;
+			if(!coll.boxB_static) {
+				bodiesDynamic.data()[coll.idB].intersecting = true;
+				_wake(coll.idB);
+				_islandUnion(coll.idA, coll.idB);
+			}
+			collisions->push(coll);
+		}
+		_scratch[t].contacts.clear();
+	}
+}
+
+// time of impact of A moving by move against B, in [0, 1]
+// only contacts that start in the future (or now) are reported, overlaps are left to the resolve steps
+static bool sweepTest(const lsk_AABB2& A, const lsk_Vec2& move, const lsk_AABB2& B, f32* out_pToi, i32* out_pAxis)
+{
+	f32 entryX = -SWEEP_INFINITY, exitX = SWEEP_INFINITY;
+	f32 entryY = -SWEEP_INFINITY, exitY = SWEEP_INFINITY;
+
+	if(move.x > 0) {
+		entryX = (B.min.x - A.max.x) / move.x;
+		exitX = (B.max.x - A.min.x) / move.x;
+	}
+	else if(move.x < 0) {
+		entryX = (B.max.x - A.min.x) / move.x;
+		exitX = (B.min.x - A.max.x) / move.x;
+	}
+	else if(A.max.x <= B.min.x || A.min.x >= B.max.x) {
+		return false; // sliding along an edge is not a hit
+	}
+
+	if(move.y > 0) {
+		entryY = (B.min.y - A.max.y) / move.y;
+		exitY = (B.max.y - A.min.y) / move.y;
+	}
+	else if(move.y < 0) {
+		entryY = (B.max.y - A.min.y) / move.y;
+		exitY = (B.min.y - A.max.y) / move.y;
+	}
+	else if(A.max.y <= B.min.y || A.min.y >= B.max.y) {
+		return false;
+	}
+
+	const f32 entry = lsk_max(entryX, entryY);
+	const f32 exit = lsk_min(exitX, exitY);
+	if(entry >= exit || entry > 1.f || entry < -SWEEP_TOI_EPSILON) {
+		return false;
+	}
+
+	*out_pToi = lsk_max(entry, 0.f);
+	*out_pAxis = entryY >= entryX ? 1 : 0; // landing wins ties
+	return true;
+}
+
+void PhysicsManager::_sweepBody(NarrowphaseScratch& scratch, i32 i, f32 delta)
+{
+	// velocity and unobstructed box come from integrateBatch(), the move is swept from the start box
+	BodyRectAligned& body = bodiesDynamic.data()[i];
+	BodyArraySoA& soa = _dynamicSoA;
+	lsk_AABB2 box = _sweepStart.box(i);
+	lsk_Vec2 vel = {soa.velX[i], soa.velY[i]};
+	lsk_Vec2 move = vel * delta;
+
+	// each hit blocks one axis, the remaining movement slides along the other
+	for(i32 it = 0; it < 2 && (move.x != 0 || move.y != 0); ++it) {
+		lsk_AABB2 sweptBox;
+		sweptBox.min = {lsk_min(box.min.x, box.min.x + move.x),
+						lsk_min(box.min.y, box.min.y + move.y)};
+		sweptBox.max = {lsk_max(box.max.x, box.max.x + move.x),
+						lsk_max(box.max.y, box.max.y + move.y)};
+
+		f32 toi = 2.f;
+		i32 axis = -1;
+		const BodyRectAligned* pHit = nullptr;
+		lsk_AABB2 hitBox;
+
+		scratch.candidates.clear();
+		_staticTree.query(sweptBox, &scratch.candidates);
+		for(u32 id: scratch.candidates) {
+			const BodyRectAligned& other = bodiesStatic.data(id);
+			f32 t;
+			i32 a;
+			if(layersInteract(body, other) && sweepTest(box, move, other.box, &t, &a) &&
+			   (!other.oneWay || (a == 1 && move.y > 0)) && (t < toi || (t == toi && a > axis))) {
+				toi = t;
+				axis = a;
+				pHit = &other;
+				hitBox = other.box;
+			}
+		}
+
+		const u32 candidateCount = _queryCandidates(scratch, bodiesKinematic, _gridKinematic,
+													_gridKinematic.computeRect(sweptBox));
+		for(u32 c = 0; c < candidateCount; ++c) {
+			const u32 id = scratch.candidates[c];
+			const BodyRectAligned& other = bodiesKinematic.data(id);
+			const lsk_AABB2 otherBox = _kinematicSoA.box(id);
+			f32 t;
+			i32 a;
+			if(layersInteract(body, other) && sweepTest(box, move, otherBox, &t, &a) &&
+			   (!other.oneWay || (a == 1 && move.y > 0)) && (t < toi || (t == toi && a > axis))) {
+				toi = t;
+				axis = a;
+				pHit = &other;
+				hitBox = otherBox;
+			}
+		}
+
+		if(!pHit) {
+			if(it == 0) {
+				return; // the batched box is already in place
+			}
+			box.min += move;
+			box.max += move;
+			break;
+		}
+
+		// snap the blocked edge onto the obstacle to avoid accumulating float error
+		if(axis == 0) {
+			const f32 snap = move.x > 0 ? hitBox.min.x - box.max.x : hitBox.max.x - box.min.x;
+			const f32 slide = move.y * toi;
+			box.min += lsk_Vec2(snap, slide);
+			box.max += lsk_Vec2(snap, slide);
+			move = {0, move.y - slide};
+			vel.x = 0;
+			body.x_locked = true;
+		}
+		else {
+			const f32 snap = move.y > 0 ? hitBox.min.y - box.max.y : hitBox.max.y - box.min.y;
+			const f32 slide = move.x * toi;
+			box.min += lsk_Vec2(slide, snap);
+			box.max += lsk_Vec2(slide, snap);
+			move = {move.x - slide, 0};
+			vel.y = 0;
+			body.y_locked = true;
+		}
+		body.intersecting = true;
+	}
+
+	soa.set(i, box, vel);
+}
+
+static inline void fixedQuantize(BodyFixed& fix, const BodyRectAligned& body)
+{
+	fix.box.minX = fixFromFloat(body.box.min.x);
+	fix.box.minY = fixFromFloat(body.box.min.y);
+	fix.box.maxX = fixFromFloat(body.box.max.x);
+	fix.box.maxY = fixFromFloat(body.box.max.y);
+	fix.velX = fixFromFloat(body.vel.x);
+	fix.velY = fixFromFloat(body.vel.y);
+}
+
+static inline void fixedWriteBack(const BodyFixed& fix, BodyRectAligned& body)
+{
+	body.box.min = {fixToFloat(fix.box.minX), fixToFloat(fix.box.minY)};
+	body.box.max = {fixToFloat(fix.box.maxX), fixToFloat(fix.box.maxY)};
+	body.vel = {fixToFloat(fix.velX), fixToFloat(fix.velY)};
+}
+
+static inline void fixedWriteBack(const BodyFixed& fix, BodyArraySoA& soa, u32 i)
+{
+	soa.minX[i] = fixToFloat(fix.box.minX);
+	soa.minY[i] = fixToFloat(fix.box.minY);
+	soa.maxX[i] = fixToFloat(fix.box.maxX);
+	soa.maxY[i] = fixToFloat(fix.box.maxY);
+	soa.velX[i] = fixToFloat(fix.velX);
+	soa.velY[i] = fixToFloat(fix.velY);
+}
+
+static inline bool fixedMatches(const BodyFixed& fix, const BodyRectAligned& body)
+{
+	return body.box.min.x == fixToFloat(fix.box.minX) && body.box.min.y == fixToFloat(fix.box.minY) &&
+		   body.box.max.x == fixToFloat(fix.box.maxX) && body.box.max.y == fixToFloat(fix.box.maxY) &&
+		   body.vel.x == fixToFloat(fix.velX) && body.vel.y == fixToFloat(fix.velY);
+}
+
+void PhysicsManager::_syncFixed(lsk_DSparseArray<BodyRectAligned>& bodies, lsk_DArray<BodyFixed>& fixed,
+								bool isStatic)
+{
+	// floats that don't match the fixed state were written by gameplay code (or the body is new)
+	const i32 count = bodies.count();
+	for(i32 i = 0; i < count; ++i) {
+		BodyRectAligned& body = bodies.data()[i];
+		if(!fixedMatches(fixed[i], body)) {
+			fixedQuantize(fixed[i], body);
+			fixedWriteBack(fixed[i], body); // snapped, they match from now on
+			if(isStatic) {
+				_staticTreeDirty = true;
+				_staticChanged = true;
+			}
+		}
+	}
+}
+
+void PhysicsManager::_integrateFixed(i32 i)
+{
+	BodyFixed& fix = _fixDynamic[i];
+	fix.velX += _fixGravityX;
+	fix.velY += _fixGravityY;
+	const fix32 moveX = fixMul(fix.velX, _fixDelta);
+	const fix32 moveY = fixMul(fix.velY, _fixDelta);
+	fix.box.minX += moveX;
+	fix.box.minY += moveY;
+	fix.box.maxX += moveX;
+	fix.box.maxY += moveY;
+	fixedWriteBack(fix, _dynamicSoA, i);
+}
+
+// sweepTest() in fixed point, the toi is a 16.16 fraction of move
+// exact, so no epsilon: overlaps are left to the resolve steps
+static bool sweepTestFixed(const FixedBox& A, fix32 moveX, fix32 moveY, const FixedBox& B, fix32* out_pToi,
+						   i32* out_pAxis)
+{
+	fix32 entryX = -I32_MAX, exitX = I32_MAX;
+	fix32 entryY = -I32_MAX, exitY = I32_MAX;
+
+	if(moveX > 0) {
+		entryX = fixDiv(B.minX - A.maxX, moveX);
+		exitX = fixDiv(B.maxX - A.minX, moveX);
+	}
+	else if(moveX < 0) {
+		entryX = fixDiv(B.maxX - A.minX, moveX);
+		exitX = fixDiv(B.minX - A.maxX, moveX);
+	}
+	else if(A.maxX <= B.minX || A.minX >= B.maxX) {
+		return false;
+	}
+
+	if(moveY > 0) {
+		entryY = fixDiv(B.minY - A.maxY, moveY);
+		exitY = fixDiv(B.maxY - A.minY, moveY);
+	}
+	else if(moveY < 0) {
+		entryY = fixDiv(B.maxY - A.minY, moveY);
+		exitY = fixDiv(B.minY - A.maxY, moveY);
+	}
+	else if(A.maxY <= B.minY || A.minY >= B.maxY) {
+		return false;
+	}
+
+	const fix32 entry = lsk_max(entryX, entryY);
+	const fix32 exit = lsk_min(exitX, exitY);
+	if(entry >= exit || entry > FIX_ONE || entry < 0) {
+		return false;
+	}
+
+	*out_pToi = entry;
+	*out_pAxis = entryY >= entryX ? 1 : 0; // landing wins ties
+	return true;
+}
+
+void PhysicsManager::_sweepBodyFixed(NarrowphaseScratch& scratch, i32 i)
+{
+	BodyRectAligned& body = bodiesDynamic.data()[i];
+	BodyFixed& fix = _fixDynamic[i];
+	fix.velX += _fixGravityX;
+	fix.velY += _fixGravityY;
+	fix32 moveX = fixMul(fix.velX, _fixDelta);
+	fix32 moveY = fixMul(fix.velY, _fixDelta);
+	FixedBox& box = fix.box;
+
+	for(i32 it = 0; it < 2 && (moveX != 0 || moveY != 0); ++it) {
+		// float conversion is monotonic, every fixed candidate overlaps the float swept box
+		lsk_AABB2 sweptBox;
+		sweptBox.min = {fixToFloat(lsk_min(box.minX, box.minX + moveX)),
+						fixToFloat(lsk_min(box.minY, box.minY + moveY))};
+		sweptBox.max = {fixToFloat(lsk_max(box.maxX, box.maxX + moveX)),
+						fixToFloat(lsk_max(box.maxY, box.maxY + moveY))};
+
+		fix32 toi = 2 * FIX_ONE;
+		i32 axis = -1;
+		const FixedBox* pHit = nullptr;
+
+		scratch.candidates.clear();
+		_staticTree.query(sweptBox, &scratch.candidates);
+		for(u32 id: scratch.candidates) {
+			const BodyRectAligned& other = bodiesStatic.data(id);
+			const FixedBox& otherBox = _fixStatic[id].box;
+			fix32 t;
+			i32 a;
+			if(layersInteract(body, other) && sweepTestFixed(box, moveX, moveY, otherBox, &t, &a) &&
+			   (!other.oneWay || (a == 1 && moveY > 0)) && (t < toi || (t == toi && a > axis))) {
+				toi = t;
+				axis = a;
+				pHit = &otherBox;
+			}
+		}
+
+		const u32 candidateCount = _queryCandidates(scratch, bodiesKinematic, _gridKinematic,
+													_gridKinematic.computeRect(sweptBox));
+		for(u32 c = 0; c < candidateCount; ++c) {
+			const u32 id = scratch.candidates[c];
+			const BodyRectAligned& other = bodiesKinematic.data(id);
+			const FixedBox& otherBox = _fixKinematic[id].box;
+			fix32 t;
+			i32 a;
+			if(layersInteract(body, other) && sweepTestFixed(box, moveX, moveY, otherBox, &t, &a) &&
+			   (!other.oneWay || (a == 1 && moveY > 0)) && (t < toi || (t == toi && a > axis))) {
+				toi = t;
+				axis = a;
+				pHit = &otherBox;
+			}
+		}
+
+		if(!pHit) {
+			box.minX += moveX;
+			box.minY += moveY;
+			box.maxX += moveX;
+			box.maxY += moveY;
+			break;
+		}
+
+		if(axis == 0) {
+			const fix32 snap = moveX > 0 ? pHit->minX - box.maxX : pHit->maxX - box.minX;
+			const fix32 slide = fixMul(moveY, toi);
+			box.minX += snap;
+			box.maxX += snap;
+			box.minY += slide;
+			box.maxY += slide;
+			moveX = 0;
+			moveY -= slide;
+			fix.velX = 0;
+			body.x_locked = true;
+		}
+		else {
+			const fix32 snap = moveY > 0 ? pHit->minY - box.maxY : pHit->maxY - box.minY;
+			const fix32 slide = fixMul(moveX, toi);
+			box.minX += slide;
+			box.maxX += slide;
+			box.minY += snap;
+			box.maxY += snap;
+			moveX -= slide;
+			moveY = 0;
+			fix.velY = 0;
+			body.y_locked = true;
+		}
+		body.intersecting = true;
+	}
+
+	fixedWriteBack(fix, _dynamicSoA, i);
+}
+
+static void sweepJob(void* pUserData, u32 begin, u32 end, u32 threadId)
+{
+	// bodies only read static and kinematic bodies, each one can be swept independently
+	PhysicsManager& pm = *(PhysicsManager*)pUserData;
+	NarrowphaseScratch& scratch = pm._scratch[threadId];
+	for(u32 a = begin; a < end; ++a) {
+		if(pm.fixedPoint) {
+			pm._sweepBodyFixed(scratch, pm._awakeIds[a]);
+		}
+		else {
+			pm._sweepBody(scratch, pm._awakeIds[a], pm._sweepDelta);
+		}
+	}
+}
+
+static inline bool oneWayAcceptFixed(const FixedBox& box, const lsk_Vec2& restPos, const BodyRectAligned& platform,
+									 const FixedBox& platformBox, fix32 pushY)
+{
+	if(!platform.oneWay) {
+		return true;
+	}
+	const fix32 startBottom = fixFromFloat(restPos.y) + (box.maxY - box.minY);
+	return pushY < 0 && startBottom <= platformBox.minY + fixFromFloat(PHYSICS_ONE_WAY_TOLERANCE);
+}
+
+static void addContactFixed(i32 idA, i32 idB, fix32 pushX, fix32 pushY, bool boxB_static,
+							lsk_DArray<CollisionInfo>* contacts)
+{
+	// one unit past the contact instead of the float epsilon, dynamic pairs split the push in
+	// truncated halves and would otherwise stay 1 unit apart forever
+	CollisionInfo coll;
+	coll.idA = idA;
+	coll.idB = idB;
+	coll.boxB_static = boxB_static;
+	coll.fixPushX = pushX + (pushX > 0) - (pushX < 0);
+	coll.fixPushY = pushY + (pushY > 0) - (pushY < 0);
+	coll.pushVec = {fixToFloat(coll.fixPushX), fixToFloat(coll.fixPushY)};
+	contacts->push(coll);
+}
+
+void PhysicsManager::_narrowphaseFixed(NarrowphaseScratch& scratch, i32 i)
+{
+	// same pairs and order as _narrowphase(), the SIMD batch test is replaced by intersectTestFixed()
+	const BodyRectAligned& bodyA = bodiesDynamic.data()[i];
+	const FixedBox& boxA = _fixDynamic[i].box;
+	const lsk_Vec2 restPos = _sleepDynamic[i].restPos;
+	const GridRect& rectA = _broadDynamic[i].rect;
+	fix32 pushX, pushY;
+
+	scratch.candidates.clear();
+	_staticTree.query(_dynamicSoA.box(i), &scratch.candidates);
+	u32 candidateCount = sortUnique(scratch.candidates.data(), scratch.candidates.count());
+	for(u32 c = 0; c < candidateCount; ++c) {
+		const u32 j = scratch.candidates[c];
+		const BodyRectAligned& bodyB = bodiesStatic.data()[j];
+		const FixedBox& boxB = _fixStatic[j].box;
+		if(layersInteract(bodyA, bodyB) && intersectTestFixed(boxA, boxB, &pushX, &pushY) &&
+		   oneWayAcceptFixed(boxA, restPos, bodyB, boxB, pushY)) {
+			addContactFixed(i, j, pushX, pushY, true, &scratch.contacts);
+		}
+	}
+
+	candidateCount = _queryCandidates(scratch, bodiesKinematic, _gridKinematic, rectA);
+	for(u32 c = 0; c < candidateCount; ++c) {
+		const u32 j = scratch.candidates[c];
+		const BodyRectAligned& bodyB = bodiesKinematic.data()[j];
+		const FixedBox& boxB = _fixKinematic[j].box;
+		if(layersInteract(bodyA, bodyB) && intersectTestFixed(boxA, boxB, &pushX, &pushY) &&
+		   oneWayAcceptFixed(boxA, restPos, bodyB, boxB, pushY)) {
+			addContactFixed(i, j, pushX, pushY, true, &scratch.contacts);
+		}
+	}
+
+	candidateCount = _queryDynamic(scratch, bodyA.mask, rectA);
+	for(u32 c = 0; c < candidateCount; ++c) {
+		const i32 j = scratch.candidates[c];
+		if(i == j) continue;
+		if(!(bodiesDynamic.data()[j].mask & bodyA.layer)) continue;
+		if(intersectTestFixed(boxA, _fixDynamic[j].box, &pushX, &pushY)) {
+			addContactFixed(i, j, pushX, pushY, false, &scratch.contacts);
+		}
+	}
+}
+
+void PhysicsManager::_resolve(lsk_DArray<CollisionInfo>& collisions)
+{
+	BodyArraySoA& soa = _dynamicSoA;
+	for(auto& coll: collisions) {
+		const i32 a = coll.idA;
+		const i32 b = coll.idB;
+		BodyRectAligned& bodyA = bodiesDynamic.data()[a];
+		const lsk_Vec2 push = coll.pushVec;
+
+		if(coll.boxB_static) {
+			soa.minX[a] += push.x;
+			soa.maxX[a] += push.x;
+			soa.minY[a] += push.y;
+			soa.maxY[a] += push.y;
+
+			if(push.x != 0) {
+				bodyA.x_locked = true;
+				soa.velX[a] = 0;
+			}
+			if(push.y != 0) {
+				bodyA.y_locked = true;
+				soa.velY[a] = 0;
+			}
+			continue;
+		}
+
+		BodyRectAligned& bodyB = bodiesDynamic.data()[b];
+		if(!bodyA.x_locked) {
+			soa.minX[a] += push.x / 2.f;
+			soa.maxX[a] += push.x / 2.f;
+		}
+		else {
+			soa.minX[b] += -push.x;
+			soa.maxX[b] += -push.x;
+		}
+
+		if(!bodyA.y_locked) {
+			soa.minY[a] += push.y / 2.f;
+			soa.maxY[a] += push.y / 2.f;
+		}
+		else {
+			soa.minY[b] += -push.y;
+			soa.maxY[b] += -push.y;
+		}
+
+		if(!bodyB.x_locked) {
+			soa.minX[b] += -push.x / 2.f;
+			soa.maxX[b] += -push.x / 2.f;
+		}
+		if(!bodyB.y_locked) {
+			soa.minY[b] += -push.y / 2.f;
+			soa.maxY[b] += -push.y / 2.f;
+		}
+
+		if(push.x != 0) {
+			soa.velX[a] = 0;
+			soa.velX[b] = 0;
+		}
+		if(push.y != 0) {
+			soa.velY[a] = 0;
+			soa.velY[b] = 0;
+		}
+	}
+}
+
+void PhysicsManager::_resolveFixed(lsk_DArray<CollisionInfo>& collisions)
+{
+	// same rules as _resolve()
+	for(auto& coll: collisions) {
+		BodyRectAligned& bodyA = bodiesDynamic.data()[coll.idA];
+		FixedBox& boxA = _fixDynamic[coll.idA].box;
+		const fix32 pushX = coll.fixPushX;
+		const fix32 pushY = coll.fixPushY;
+
+		if(coll.boxB_static) {
+			boxA.minX += pushX;
+			boxA.maxX += pushX;
+			boxA.minY += pushY;
+			boxA.maxY += pushY;
+
+			if(pushX != 0) {
+				bodyA.x_locked = true;
+				_fixDynamic[coll.idA].velX = 0;
+			}
+			if(pushY != 0) {
+				bodyA.y_locked = true;
+				_fixDynamic[coll.idA].velY = 0;
+			}
+			continue;
+		}
+
+		BodyRectAligned& bodyB = bodiesDynamic.data()[coll.idB];
+		FixedBox& boxB = _fixDynamic[coll.idB].box;
+		if(!bodyA.x_locked) {
+			boxA.minX += pushX / 2;
+			boxA.maxX += pushX / 2;
+		}
+		else {
+			boxB.minX -= pushX;
+			boxB.maxX -= pushX;
+		}
+
+		if(!bodyA.y_locked) {
+			boxA.minY += pushY / 2;
+			boxA.maxY += pushY / 2;
+		}
+		else {
+			boxB.minY -= pushY;
+			boxB.maxY -= pushY;
+		}
+
+		if(!bodyB.x_locked) {
+			boxB.minX -= pushX / 2;
+			boxB.maxX -= pushX / 2;
+		}
+		if(!bodyB.y_locked) {
+			boxB.minY -= pushY / 2;
+			boxB.maxY -= pushY / 2;
+		}
+
+		if(pushX != 0) {
+			_fixDynamic[coll.idA].velX = 0;
+			_fixDynamic[coll.idB].velX = 0;
+		}
+		if(pushY != 0) {
+			_fixDynamic[coll.idA].velY = 0;
+			_fixDynamic[coll.idB].velY = 0;
+		}
+	}
+
+	// the next step's broadphase runs on the float boxes
+	for(auto& coll: collisions) {
+		fixedWriteBack(_fixDynamic[coll.idA], _dynamicSoA, coll.idA);
+		if(!coll.boxB_static) {
+			fixedWriteBack(_fixDynamic[coll.idB], _dynamicSoA, coll.idB);
+		}
+	}
+}
+
+void PhysicsManager::_syncDynamic()
+{
+	// bodies whose box or velocity differ from the solver were written by gameplay code
+	const i32 count = bodiesDynamic.count();
+	for(i32 i = 0; i < count; ++i) {
+		BodyRectAligned& body = bodiesDynamic.data()[i];
+		if(fixedPoint && !fixedMatches(_fixDynamic[i], body)) {
+			fixedQuantize(_fixDynamic[i], body);
+			fixedWriteBack(_fixDynamic[i], body);
+		}
+		if(!_dynamicSoA.matches(i, body.box, body.vel)) {
+			_dynamicSoA.set(i, body.box, body.vel);
+		}
+	}
+}
+
+void PhysicsManager::_syncKinematic()
+{
+	// moved by gameplay code in-between updates, sleeping bodies they now touch wake up
+	const i32 count = bodiesKinematic.count();
+	for(i32 i = 0; i < count; ++i) {
+		const BodyRectAligned& body = bodiesKinematic.data()[i];
+		if(!_kinematicSoA.matches(i, body.box, body.vel)) {
+			_kinematicSoA.set(i, body.box, body.vel);
+			wakeInBox(body.box);
+		}
+	}
+}
+
+void PhysicsManager::update(f64 delta)
+{
+	const i32 dynamicCount = bodiesDynamic.count();
+
+	if(fixedPoint) {
+		_syncFixed(bodiesStatic, _fixStatic, true);
+		_syncFixed(bodiesKinematic, _fixKinematic, false);
+		_fixDelta = fixFromFloat((f32)delta);
+		_fixGravityX = fixFromFloat(gravity.x);
+		_fixGravityY = fixFromFloat(gravity.y);
+	}
+	_syncDynamic();
+
+	if(_staticTreeDirty) {
+		_staticTree.build(bodiesStatic);
+		_staticTreeDirty = false;
+	}
+	if(_staticChanged) {
+		_staticChanged = false;
+		for(i32 i = 0; i < dynamicCount; ++i) {
+			_wake(i);
+		}
+	}
+
+	// gameplay code wrote the velocity or position of a sleeping body
+	for(i32 i = 0; i < dynamicCount; ++i) {
+		const BodyRectAligned& body = bodiesDynamic.data()[i];
+		const lsk_Vec2& restPos = _sleepDynamic[i].restPos;
+		if(body.sleeping && (body.vel.x != 0 || body.vel.y != 0 ||
+		   body.box.min.x != restPos.x || body.box.min.y != restPos.y)) {
+			_wake(i);
+		}
+	}
+
+	_syncGrid(bodiesKinematic, _gridKinematic, _broadKinematic);
+	_syncLayerGrids();
+	_syncKinematic();
+
+	_awakeIds.clear();
+	_gravityScale.clear();
+	for(i32 i = 0; i < dynamicCount; ++i) {
+		BodyRectAligned& body = bodiesDynamic.data()[i];
+		_gravityScale.push(body.sleeping ? 0.f : 1.f);
+		if(!body.sleeping) {
+			_sleepDynamic[i].restPos = {_dynamicSoA.minX[i], _dynamicSoA.minY[i]};
+			body.intersecting = false;
+			_awakeIds.push(i);
+		}
+	}
+	while(_gravityScale.count() % PHYSICS_SIMD_WIDTH) {
+		_gravityScale.push(0.f);
+	}
+
+	if(fixedPoint) {
+		if(sweepStatic) {
+			Jobs.parallelFor(_awakeIds.count(), PHYSICS_NARROWPHASE_MIN_BODIES, sweepJob, this);
+		}
+		else {
+			for(auto i: _awakeIds) {
+				_integrateFixed(i);
+			}
+		}
+	}
+	else {
+		if(sweepStatic) {
+			_sweepStart.copy(_dynamicSoA);
+		}
+
+		integrateBatch(_dynamicSoA, _gravityScale.data(), gravity, delta);
+
+		if(sweepStatic) {
+			// bodies start from the batched result, the sweep only corrects the ones that hit something
+			_sweepDelta = (f32)delta;
+			Jobs.parallelFor(_awakeIds.count(), PHYSICS_NARROWPHASE_MIN_BODIES, sweepJob, this);
+		}
+	}
+
+	_islandParent.clear();
+	_islandFlags.clear();
+	for(i32 i = 0; i < dynamicCount; ++i) {
+		_islandParent.push(i);
+		_islandFlags.push(0);
+	}
+
+	lsk_DArray<CollisionInfo> collisions(64);
+	bool resolveCollisions = true;
+	for(i32 step = 0; step < 4 && resolveCollisions; ++step) {
+		resolveCollisions = false;
+		collisions.clear();
+
+		_syncLayerGrids();
+
+		// bodies woken up by a contact are appended to _awakeIds and tested in another pass
+		u32 tested = 0;
+		while(tested < _awakeIds.count()) {
+			_stepIds.clear();
+			const u32 awakeCount = _awakeIds.count();
+			for(u32 a = tested; a < awakeCount; ++a) {
+				const i32 i = _awakeIds[a];
+				// islands without contacts on the previous step are resolved
+				if(step > 0 && !_islandFlags[_islandFind(i)]) {
+					continue;
+				}
+				_stepIds.push(i);
+			}
+			tested = awakeCount;
+
+			const u32 threadCount = Jobs.threadCount();
+			Jobs.parallelFor(_stepIds.count(), PHYSICS_NARROWPHASE_MIN_BODIES, narrowphaseJob, this);
+			_mergeContacts(threadCount, &collisions);
+		}
+
+		// touching contacts (zero push) are stable, only penetrations need another step
+		memset(_islandFlags.data(), 0, dynamicCount);
+		for(auto& coll: collisions) {
+			if(coll.pushVec.x != 0 || coll.pushVec.y != 0) {
+				_islandFlags[_islandFind(coll.idA)] = 1;
+				resolveCollisions = true;
+			}
+		}
+
+		if(fixedPoint) {
+			_resolveFixed(collisions);
+		}
+		else {
+			_resolve(collisions);
+		}
+
+		//lsk_printf("step=%d", step);
+	}
+
+	// only awake bodies moved, copy them back for gameplay code
+	for(auto i: _awakeIds) {
+		BodyRectAligned& body = bodiesDynamic.data()[i];
+		body.box = _dynamicSoA.box(i);
+		body.vel = {_dynamicSoA.velX[i], _dynamicSoA.velY[i]};
+	}
+
+	// keep the grid up to date for spatial queries
+	_syncLayerGrids();
+	_updateSleep();
+}
+
+void PhysicsManager::wake(BodyRectAligned& body)
+{
+	_wake((i32)(&body - bodiesDynamic.data()));
+}
+
+void PhysicsManager::_wake(i32 i)
+{
+	if(!bodiesDynamic.data()[i].sleeping) {
+		return;
+	}
+
+	// walk the island list from its root, removing a body wakes its island so every member is alive
+	const u32 island = _sleepDynamic[i].island;
+	u32 refId = island - 1;
+	while(true) {
+		const u32 did = bodiesDynamic.dataId(refId);
+		BodySleep& sleep = _sleepDynamic[did];
+		assert(bodiesDynamic.data()[did].sleeping && sleep.island == island);
+		bodiesDynamic.data()[did].sleeping = false;
+		sleep.restTicks = 0;
+		sleep.restPos = {_dynamicSoA.minX[did], _dynamicSoA.minY[did]};
+		_awakeIds.push((i32)did);
+		if(!sleep.islandNext) {
+			break;
+		}
+		refId = sleep.islandNext - 1;
+		sleep.islandNext = 0;
+	}
+}
+
+void PhysicsManager::wakeInBox(const lsk_AABB2& box)
+{
+	// writes sleep state, like wake()
+	assert(JobPool::threadId() == 0 && !Jobs._busy.load(std::memory_order_relaxed));
+	NarrowphaseScratch& scratch = _scratch[0];
+	const u32 candidateCount = _queryDynamic(scratch, PHYSICS_LAYER_ALL, layerGridRect(box));
+	for(u32 c = 0; c < candidateCount; ++c) {
+		BodyRectAligned& body = bodiesDynamic.data()[scratch.candidates[c]];
+		lsk_Vec2 pushVec;
+		if(body.sleeping && intersectTest(box, body.box, &pushVec)) {
+			wake(body);
+		}
+	}
+}
+
+i32 PhysicsManager::_islandFind(i32 i)
+{
+	i32* parent = _islandParent.data();
+	while(parent[i] != i) {
+		parent[i] = parent[parent[i]]; // path halving
+		i = parent[i];
+	}
+	return i;
+}
+
+void PhysicsManager::_islandUnion(i32 a, i32 b)
+{
+	i32 rootA = _islandFind(a);
+	i32 rootB = _islandFind(b);
+	if(rootA == rootB) {
+		return;
+	}
+
+	// lowest id is the root, keeps islands independent of contact order
+	if(rootB < rootA) {
+		i32 t = rootA;
+		rootA = rootB;
+		rootB = t;
+	}
+	_islandParent[rootB] = rootA;
+	_islandFlags[rootA] |= _islandFlags[rootB];
+}
+
+void PhysicsManager::_updateSleep()
+{
+	const i32 dynamicCount = bodiesDynamic.count();
+	memset(_islandFlags.data(), 1, dynamicCount); // island can sleep
+
+	const u32 awakeCount = _awakeIds.count();
+	for(u32 a = 0; a < awakeCount; ++a) {
+		const i32 i = _awakeIds[a];
+		const BodyRectAligned& body = bodiesDynamic.data()[i];
+		BodySleep& sleep = _sleepDynamic[i];
+		// gravity was cancelled by a contact (ground or a body underneath) and the body did not move
+		lsk_Vec2 moved = body.box.min - sleep.restPos;
+		if(body.intersecting && body.vel.x == 0 && body.vel.y == 0 &&
+		   lsk_abs(moved.x) <= PHYSICS_SLEEP_TOLERANCE && lsk_abs(moved.y) <= PHYSICS_SLEEP_TOLERANCE) {
+			if(sleep.restTicks < PHYSICS_SLEEP_TICKS) {
+				++sleep.restTicks;
+			}
+		}
+		else {
+			sleep.restTicks = 0;
+		}
+		sleep.islandNext = 0;
+
+		if(sleep.restTicks < PHYSICS_SLEEP_TICKS) {
+			_islandFlags[_islandFind(i)] = 0;
+		}
+	}
+
+	for(u32 a = 0; a < awakeCount; ++a) {
+		const i32 i = _awakeIds[a];
+		const i32 root = _islandFind(i);
+		if(!_islandFlags[root]) {
+			continue;
+		}
+
+		// the root ref id is unique among sleeping islands, removing a body wakes its island
+		BodyRectAligned& body = bodiesDynamic.data()[i];
+		BodySleep& sleep = _sleepDynamic[i];
+		body.sleeping = true;
+		sleep.island = bodiesDynamic.refId(root) + 1;
+		if(i != root) {
+			// inserted after the root, wake() starts from it
+			sleep.islandNext = _sleepDynamic[root].islandNext;
+			_sleepDynamic[root].islandNext = bodiesDynamic.refId(i) + 1;
+		}
+		body.vel = {};
+		_dynamicSoA.velX[i] = 0;
+		_dynamicSoA.velY[i] = 0;
+		_fixDynamic[i].velX = 0;
+		_fixDynamic[i].velY = 0;
+		sleep.restPos = body.box.min;
+	}
+}
+
+static inline bool queryAccept(const BodyRectAligned& body, const QueryFilter& filter)
+{
+	if(&body == filter.pIgnore) {
+		return false;
+	}
+	if(!(body.layer & filter.layerMask)) {
+		return false;
+	}
+	return true;
+}
+
+// slab test, t in [0, maxT] along from + dir * t
+static bool rayBoxTest(const lsk_Vec2& from, const lsk_Vec2& dir, f32 minX, f32 minY, f32 maxX, f32 maxY,
+					   f32 maxT, f32* out_pT, lsk_Vec2* out_pNormal)
+{
+	f32 tmin = 0;
+	f32 tmax = maxT;
+	lsk_Vec2 normal = {};
+
+	if(dir.x == 0) {
+		if(from.x < minX || from.x > maxX) return false;
+	}
+	else {
+		f32 t0 = (minX - from.x) / dir.x;
+		f32 t1 = (maxX - from.x) / dir.x;
+		f32 n = -1.f;
+		if(t0 > t1) {
+			f32 t = t0; t0 = t1; t1 = t;
+			n = 1.f;
+		}
+		if(t0 > tmin) {
+			tmin = t0;
+			normal = {n, 0};
+		}
+		if(t1 < tmax) tmax = t1;
+		if(tmin > tmax) return false;
+	}
+
+	if(dir.y == 0) {
+		if(from.y < minY || from.y > maxY) return false;
+	}
+	else {
+		f32 t0 = (minY - from.y) / dir.y;
+		f32 t1 = (maxY - from.y) / dir.y;
+		f32 n = -1.f;
+		if(t0 > t1) {
+			f32 t = t0; t0 = t1; t1 = t;
+			n = 1.f;
+		}
+		if(t0 > tmin) {
+			tmin = t0;
+			normal = {0, n};
+		}
+		if(t1 < tmax) tmax = t1;
+		if(tmin > tmax) return false;
+	}
+
+	*out_pT = tmin;
+	if(out_pNormal) {
+		*out_pNormal = normal;
+	}
+	return true;
+}
+
+static void rayBodyTest(BodyRectAligned& body, u32 id, u8 type, const lsk_Vec2& from, const lsk_Vec2& dir,
+						RaycastHit* best)
+{
+	f32 t;
+	lsk_Vec2 normal;
+	if(rayBoxTest(from, dir, body.box.min.x, body.box.min.y, body.box.max.x, body.box.max.y, best->t,
+				  &t, &normal)) {
+		// equal distances: lowest type then ref id, independent of traversal order
+		if(best->pBody && t == best->t && (type > best->type || (type == best->type && id > best->id))) {
+			return;
+		}
+		best->pBody = &body;
+		best->id = id;
+		best->type = type;
+		best->t = t;
+		best->normal = normal;
+	}
+}
+
+void PhysicsManager::_queryGrid(lsk_DSparseArray<BodyRectAligned>& bodies, const BroadphaseGrid& grid, u8 type,
+								const lsk_AABB2& box, const QueryFilter& filter, lsk_DArray<QueryHit>* out)
+{
+	NarrowphaseScratch& scratch = _scratch[JobPool::threadId()];
+	scratch.candidates.clear();
+	grid.query(grid.computeRect(box), &scratch.candidates);
+	const u32 count = sortUnique(scratch.candidates.data(), scratch.candidates.count());
+
+	for(u32 c = 0; c < count; ++c) {
+		const u32 id = scratch.candidates[c];
+		BodyRectAligned& body = bodies.get(id);
+		if(queryAccept(body, filter) && intersectTest(box, body.box, nullptr)) {
+			out->push({&body, id, type});
+		}
+	}
+}
+
+void PhysicsManager::_queryStaticTree()
+{
+	if(_staticTreeDirty) {
+		// the only write of a query, static bodies changed since the last update
+		assert_msg(!Jobs._busy.load(std::memory_order_relaxed),
+				   "Static bodies changed, update or query once before querying from parallel systems");
+		_staticTree.build(bodiesStatic);
+		_staticTreeDirty = false;
+	}
+}
+
+u32 PhysicsManager::queryAABB(const lsk_AABB2& box, const QueryFilter& filter, lsk_DArray<QueryHit>* out)
+{
+	const u32 start = out->count();
+
+	if(filter.bodyTypes & QUERY_STATIC) {
+		_queryStaticTree();
+
+		NarrowphaseScratch& scratch = _scratch[JobPool::threadId()];
+		scratch.candidates.clear();
+		_staticTree.query(box, &scratch.candidates);
+
+		// data ids -> ref ids
+		const u32 count = scratch.candidates.count();
+		u32* ids = scratch.candidates.data();
+		for(u32 c = 0; c < count; ++c) {
+			ids[c] = bodiesStatic.refId(ids[c]);
+		}
+		const u32 uniqueCount = sortUnique(ids, count);
+
+		for(u32 c = 0; c < uniqueCount; ++c) {
+			BodyRectAligned& body = bodiesStatic.get(ids[c]);
+			if(queryAccept(body, filter) && intersectTest(box, body.box, nullptr)) {
+				out->push({&body, ids[c], BODYTYPE_STATIC});
+			}
+		}
+	}
+
+	if(filter.bodyTypes & QUERY_KINEMATIC) {
+		_queryGrid(bodiesKinematic, _gridKinematic, BODYTYPE_KINEMATIC, box, filter, out);
+	}
+
+	if(filter.bodyTypes & QUERY_DYNAMIC) {
+		NarrowphaseScratch& scratch = _scratch[JobPool::threadId()];
+		const u32 count = _queryDynamic(scratch, filter.layerMask, layerGridRect(box));
+		for(u32 c = 0; c < count; ++c) {
+			const u32 did = scratch.candidates[c];
+			BodyRectAligned& body = bodiesDynamic.data()[did];
+			if(queryAccept(body, filter) && intersectTest(box, body.box, nullptr)) {
+				out->push({&body, bodiesDynamic.refId(did), BODYTYPE_DYNAMIC});
+			}
+		}
+	}
+
+	return out->count() - start;
+}
+
+u32 PhysicsManager::queryPoint(const lsk_Vec2& point, const QueryFilter& filter, lsk_DArray<QueryHit>* out)
+{
+	lsk_AABB2 box;
+	box.min = point;
+	box.max = point;
+	return queryAABB(box, filter, out);
+}
+
+void PhysicsManager::_raycastGrid(lsk_DSparseArray<BodyRectAligned>& bodies, const BroadphaseGrid& grid, u8 type,
+								  const lsk_Vec2& from, const lsk_Vec2& to, const QueryFilter& filter,
+								  RaycastHit* best)
+{
+	// walk the cells crossed by the segment in order (Amanatides & Woo),
+	// stop once the closest hit is before the current cell exit
+	const f32 cellSize = grid._cellSize;
+	const lsk_Vec2 dir = to - from;
+	NarrowphaseScratch& scratch = _scratch[JobPool::threadId()];
+
+	i32 x = gridCoord(from.x, cellSize);
+	i32 y = gridCoord(from.y, cellSize);
+	const i32 endX = gridCoord(to.x, cellSize);
+	const i32 endY = gridCoord(to.y, cellSize);
+	const i32 stepX = dir.x > 0 ? 1 : -1;
+	const i32 stepY = dir.y > 0 ? 1 : -1;
+	f32 tMaxX = dir.x != 0 ? ((x + (stepX > 0)) * cellSize - from.x) / dir.x : SWEEP_INFINITY;
+	f32 tMaxY = dir.y != 0 ? ((y + (stepY > 0)) * cellSize - from.y) / dir.y : SWEEP_INFINITY;
+	const f32 tDeltaX = dir.x != 0 ? cellSize / lsk_abs(dir.x) : SWEEP_INFINITY;
+	const f32 tDeltaY = dir.y != 0 ? cellSize / lsk_abs(dir.y) : SWEEP_INFINITY;
+	i32 cellsLeft = lsk_abs(endX - x) + lsk_abs(endY - y) + 1;
+
+	while(cellsLeft-- > 0) {
+		GridRect cell;
+		cell.minX = cell.maxX = x;
+		cell.minY = cell.maxY = y;
+		scratch.candidates.clear();
+		grid.query(cell, &scratch.candidates);
+		for(u32 id: scratch.candidates) {
+			BodyRectAligned& body = bodies.get(id);
+			if(queryAccept(body, filter)) {
+				rayBodyTest(body, id, type, from, dir, best);
+			}
+		}
+
+		if(best->pBody && best->t <= lsk_min(tMaxX, tMaxY)) {
+			break;
+		}
+
+		if(tMaxX < tMaxY) {
+			x += stepX;
+			tMaxX += tDeltaX;
+		}
+		else {
+			y += stepY;
+			tMaxY += tDeltaY;
+		}
+	}
+}
+
+bool PhysicsManager::raycast(const lsk_Vec2& from, const lsk_Vec2& to, const QueryFilter& filter,
+							 RaycastHit* out)
+{
+	RaycastHit best;
+	const lsk_Vec2 dir = to - from;
+
+	if(filter.bodyTypes & QUERY_STATIC) {
+		_queryStaticTree();
+
+		const i32 nodeCount = _staticTree._nodes.count();
+		const StaticTree::Node* nodes = _staticTree._nodes.data();
+		const u32* items = _staticTree._items.data();
+
+		i32 n = 0;
+		while(n < nodeCount) {
+			const StaticTree::Node& node = nodes[n];
+			f32 t;
+			if(!rayBoxTest(from, dir, node.minX, node.minY, node.maxX, node.maxY, best.t, &t, nullptr)) {
+				n = node.escape;
+				continue;
+			}
+
+			for(i32 i = 0; i < node.count; ++i) {
+				const u32 did = items[node.first + i];
+				BodyRectAligned& body = bodiesStatic.data()[did];
+				if(queryAccept(body, filter)) {
+					rayBodyTest(body, bodiesStatic.refId(did), BODYTYPE_STATIC, from, dir, &best);
+				}
+			}
+			++n;
+		}
+	}
+
+	if(filter.bodyTypes & QUERY_KINEMATIC) {
+		_raycastGrid(bodiesKinematic, _gridKinematic, BODYTYPE_KINEMATIC, from, to, filter, &best);
+	}
+
+	if(filter.bodyTypes & QUERY_DYNAMIC) {
+		for(u32 l = 0; l < PHYSICS_MAX_LAYERS; ++l) {
+			if(filter.layerMask & _dynamicLayers & (1u << l)) {
+				_raycastGrid(bodiesDynamic, _gridDynamic[l], BODYTYPE_DYNAMIC, from, to, filter, &best);
+			}
+		}
+	}
+
+	if(!best.pBody) {
+		return false;
+	}
+
+	best.point = from + dir * best.t;
+	*out = best;
+	return true;
 }
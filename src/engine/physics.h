@@ -1,7 +1,79 @@
 #pragma once
 #include <lsk/lsk_array.h>
 #include <lsk/lsk_math.h>
+#include "jobs.h"
 
+#define PHYSICS_GRID_CELL_SIZE 14.f // same as map tiles
+#define PHYSICS_MAX_LAYERS 32
+#define PHYSICS_LAYER_DEFAULT 1u
+#define PHYSICS_LAYER_ALL 0xffffffffu
+#define STATIC_TREE_LEAF_SIZE 4
+#define PHYSICS_NARROWPHASE_MIN_BODIES 32 // per thread, smaller steps run on the calling thread
+#define PHYSICS_ONE_WAY_TOLERANCE 0.1f // how far below the top a body may start and still land
+#define PHYSICS_SLEEP_TICKS 30 // ticks at rest before an island goes to sleep
+#define PHYSICS_SLEEP_TOLERANCE 0.01f // max displacement per tick while at rest
+#define FIX_SHIFT 16
+#define FIX_ONE (1 << FIX_SHIFT)
+
+// inclusive range of grid cells
+struct GridRect
+{
+	i32 minX = 0, minY = 0;
+	i32 maxX = -1, maxY = -1; // empty
+
+	inline bool isEmpty() const {
+		return maxX < minX || maxY < minY;
+	}
+
+	inline bool contains(i32 x, i32 y) const {
+		return x >= minX && x <= maxX && y >= minY && y <= maxY;
+	}
+
+	inline bool operator==(const GridRect& o) const {
+		return minX == o.minX && minY == o.minY && maxX == o.maxX && maxY == o.maxY;
+	}
+
+	inline bool operator!=(const GridRect& o) const {
+		return !(*this == o);
+	}
+};
+
+/**
+ * 16.16 fixed point, used by PhysicsManager::fixedPoint
+ * - integer only, results do not depend on the compiler, float flags, SIMD width or thread count
+ * - conversions scale by a power of two, float <-> fixed is the same on every build
+ */
+typedef i32 fix32;
+
+inline fix32 fixFromFloat(f32 v) {
+	return (fix32)floorf(v * (f32)FIX_ONE + 0.5f);
+}
+
+inline f32 fixToFloat(fix32 v) {
+	return (f32)v * (1.f / (f32)FIX_ONE);
+}
+
+inline fix32 fixMul(fix32 a, fix32 b) {
+	return (fix32)(((i64)a * (i64)b) >> FIX_SHIFT);
+}
+
+// clamped to the fix32 range when b is tiny
+inline fix32 fixDiv(fix32 a, fix32 b) {
+	const i64 q = ((i64)a * FIX_ONE) / b;
+	return (fix32)lsk_clamp(q, (i64)-I32_MAX, (i64)I32_MAX);
+}
+
+struct FixedBox
+{
+	fix32 minX = 0, minY = 0;
+	fix32 maxX = 0, maxY = 0;
+};
+
+/**
+ * Body as seen by gameplay code
+ * - box and vel are copied to the solver arrays when they change, and back once per update
+ * - solver state lives in PhysicsManager side arrays, indexed by the same data id
+ */
 struct BodyRectAligned
 {
 	lsk_AABB2 box;
@@ -9,7 +81,10 @@ struct BodyRectAligned
 	u8 x_locked = false;
 	u8 y_locked = false;
 	u8 intersecting = false;
-	i32 group = -1;
+	u8 oneWay = false; // static and kinematic bodies: only stops bodies landing on its top edge
+	u8 sleeping = false;
+	u32 layer = PHYSICS_LAYER_DEFAULT; // a single bit
+	u32 mask = PHYSICS_LAYER_ALL; // layers this body collides with
 	void* pUserData = nullptr;
 
 	inline void setPos(const lsk_Vec2& pos) {
@@ -24,28 +99,355 @@ struct BodyRectAligned
 	}
 };
 
+// both bodies must accept the other one's layer
+inline bool layersInteract(const BodyRectAligned& a, const BodyRectAligned& b)
+{
+	return (a.layer & b.mask) && (b.layer & a.mask);
+}
+
+// broadphase state of a dynamic or kinematic body
+struct BodyBroadphase
+{
+	GridRect rect; // cells currently occupied
+	i32 layer = -1; // dynamic: layer grid currently occupied
+};
+
+// sleep state of a dynamic body
+struct BodySleep
+{
+	lsk_Vec2 restPos = {}; // box.min at tick start, or when it fell asleep
+	u32 island = 0; // sleeping island tag (root ref id + 1), bodies of the same island wake up together
+	u32 islandNext = 0; // sleeping: next island member ref id + 1, the list starts at the root
+	u16 restTicks = 0;
+};
+
+// fixedPoint mode: authoritative state, box and vel are rebuilt from it
+struct BodyFixed
+{
+	FixedBox box;
+	fix32 velX = 0, velY = 0;
+};
+
 struct CollisionInfo
 {
-	BodyRectAligned* pBodyA;
-	BodyRectAligned* pBodyB;
+	i32 idA; // dynamic body data id
+	i32 idB; // dynamic body data id, static or kinematic when boxB_static
 	lsk_Vec2 pushVec;
+	fix32 fixPushX = 0, fixPushY = 0; // fixedPoint mode, pushVec is its float conversion
 	u8 boxB_static = false;
 };
 
 bool intersectTest(const lsk_AABB2& A, const lsk_AABB2& B, lsk_Vec2* out_pPushVec);
+bool intersectTestFixed(const FixedBox& A, const FixedBox& B, fix32* out_pPushX, fix32* out_pPushY);
+
+/**
+ * Body boxes and velocities stored as separate aligned arrays
+ * - hot data only, read by the SIMD kernels
+ * - capacity is a multiple of PHYSICS_SIMD_WIDTH, kernels may read and write lanes past count
+ * - batch tests over a range need padded lanes (see pad())
+ */
+#define PHYSICS_SIMD_WIDTH 8
+
+struct BodyArraySoA
+{
+	f32* minX = nullptr;
+	f32* minY = nullptr;
+	f32* maxX = nullptr;
+	f32* maxY = nullptr;
+	f32* velX = nullptr;
+	f32* velY = nullptr;
+	u32 count = 0;
+	u32 capacity = 0;
+	lsk_Block _block = NULL_BLOCK;
+
+	~BodyArraySoA() {
+		destroy();
+	}
 
+	void reserve(u32 newCapacity);
+	void destroy();
+	void clear();
+	void push(const lsk_AABB2& box, const lsk_Vec2& vel = {});
+	void remove(u32 id); // the last lane fills the hole, like lsk_DSparseArray
+	void pad(u32 multiple); // push empty boxes until count is a multiple
+	void copy(const BodyArraySoA& other);
+
+	inline void set(u32 i, const lsk_AABB2& box, const lsk_Vec2& vel) {
+		minX[i] = box.min.x;
+		minY[i] = box.min.y;
+		maxX[i] = box.max.x;
+		maxY[i] = box.max.y;
+		velX[i] = vel.x;
+		velY[i] = vel.y;
+	}
+
+	inline bool matches(u32 i, const lsk_AABB2& box, const lsk_Vec2& vel) const {
+		return minX[i] == box.min.x && minY[i] == box.min.y && maxX[i] == box.max.x && maxY[i] == box.max.y &&
+			   velX[i] == vel.x && velY[i] == vel.y;
+	}
+
+	inline lsk_AABB2 box(u32 i) const {
+		lsk_AABB2 b;
+		b.min = {minX[i], minY[i]};
+		b.max = {maxX[i], maxY[i]};
+		return b;
+	}
+};
+
+struct BatchHit
+{
+	lsk_Vec2 pushVec;
+	u32 index;
+};
+
+// tests A against boxes [start, start + count) (count is rounded up to 4, lanes must exist)
+// appends hits in increasing index order, results are identical to intersectTest()
+void intersectTestBatch(const lsk_AABB2& A, const BodyArraySoA& boxes, u32 start, u32 count,
+						lsk_DArray<BatchHit>* out);
+// same test on the lanes listed in ids, hit indices are taken from ids
+void intersectTestGather(const lsk_AABB2& A, const BodyArraySoA& boxes, const u32* ids, u32 count,
+						 lsk_DArray<BatchHit>* out);
+
+/**
+ * Uniform grid broadphase (spatial hash)
+ * - stores lsk_DSparseArray ref ids (stable across removes)
+ * - a body is only moved when the range of cells it overlaps changes
+ * - cells are linked lists of nodes taken from a single pool
+ */
+struct BroadphaseGrid
+{
+	struct Node {
+		u32 id;
+		i32 next;
+	};
+
+	f32 _cellSize = PHYSICS_GRID_CELL_SIZE;
+	lsk_DHashMap<u32, i32> _cellHead; // cell key -> first node
+	lsk_DArray<Node> _nodes;
+	i32 _freeNode = -1;
+
+	void init(u32 capacity, f32 cellSize = PHYSICS_GRID_CELL_SIZE);
+	void destroy();
+
+	GridRect computeRect(const lsk_AABB2& box) const;
+	void insert(u32 id, const GridRect& rect);
+	void remove(u32 id, const GridRect& rect);
+	void move(u32 id, const GridRect& oldRect, const GridRect& newRect);
+
+	// appends every id found in rect, an id can appear multiple times
+	void query(const GridRect& rect, lsk_DArray<u32>* out) const;
+
+	void _insertCell(u32 id, i32 x, i32 y);
+	void _removeCell(u32 id, i32 x, i32 y);
+};
+
+/**
+ * Flat AABB tree over static bodies
+ * - built once, static bodies are not expected to move
+ * - nodes are stored depth-first and traversed without a stack (escape index)
+ * - leaves hold up to STATIC_TREE_LEAF_SIZE bodies
+ */
+struct StaticTree
+{
+	struct Node {
+		f32 minX, minY, maxX, maxY;
+		i32 escape; // next node to visit when this subtree is skipped
+		i32 first;  // leaf: first item
+		i32 count;  // leaf: item count, 0 for inner nodes
+		i32 _pad;
+	};
+
+	struct BuildItem {
+		f32 cx, cy;
+		u32 id;
+	};
+
+	lsk_DArray<Node> _nodes;
+	lsk_DArray<u32> _items; // static body data ids, grouped by leaf
+	BodyArraySoA _boxes; // leaf boxes, same order as _items
+
+	void init(u32 capacity);
+	void destroy();
+
+	void build(const lsk_DSparseArray<BodyRectAligned>& bodies);
+	// appends the data id of every body whose box overlaps (or touches) box
+	void query(const lsk_AABB2& box, lsk_DArray<u32>* out) const;
+	// narrowphase against overlapping leaves, hit indices are static body data ids
+	void queryIntersect(const lsk_AABB2& box, lsk_DArray<BatchHit>* out) const;
+
+	void _buildNode(const lsk_DSparseArray<BodyRectAligned>& bodies, BuildItem* items, u32 count);
+};
+
+enum BodyType: u8 {
+	BODYTYPE_DYNAMIC = 0,
+	BODYTYPE_STATIC,
+	BODYTYPE_KINEMATIC,
+};
+
+enum: u32 {
+	QUERY_DYNAMIC = 1 << BODYTYPE_DYNAMIC,
+	QUERY_STATIC = 1 << BODYTYPE_STATIC,
+	QUERY_KINEMATIC = 1 << BODYTYPE_KINEMATIC,
+	QUERY_ALL = QUERY_DYNAMIC | QUERY_STATIC | QUERY_KINEMATIC,
+};
+
+struct QueryFilter
+{
+	u32 bodyTypes = QUERY_ALL;
+	u32 layerMask = PHYSICS_LAYER_ALL; // layers to look for
+	const BodyRectAligned* pIgnore = nullptr; // usually the body doing the query
+};
+
+struct QueryHit
+{
+	BodyRectAligned* pBody;
+	u32 id; // ref id in the body type array, stable
+	u8 type; // BodyType
+};
+
+struct RaycastHit
+{
+	BodyRectAligned* pBody = nullptr;
+	u32 id = 0;
+	u8 type = 0;
+	f32 t = 1.f; // from + (to - from) * t
+	lsk_Vec2 point = {};
+	lsk_Vec2 normal = {}; // zero when the ray starts inside the body
+};
+
+/**
+ * Per-thread narrowphase buffers
+ * - contacts are written by one thread, then merged in thread order
+ */
+struct NarrowphaseScratch
+{
+	lsk_DArray<u32> candidates;
+	lsk_DArray<BatchHit> hits;
+	lsk_DArray<CollisionInfo> contacts;
+
+	void init();
+	void destroy();
+};
+
+/**
+ * Sleeping
+ * - a dynamic body is at rest when a contact cancelled gravity and it did not move for a tick
+ * - contacts between dynamic bodies group them into islands (union-find, rebuilt every tick)
+ * - an island sleeps once all its bodies have been at rest for PHYSICS_SLEEP_TICKS
+ * - sleeping bodies are not integrated nor tested as A, they are still hit by awake bodies
+ * - a sleeping island wakes up when one of its bodies is touched by an awake or kinematic body,
+ *   when gameplay code writes its velocity or position, or through wake() / wakeInBox()
+ */
 struct PhysicsManager
 {
 	SINGLETON_IMP(PhysicsManager)
 
 	lsk_Vec2 gravity = {0, 10.f};
+	// swept-AABB time of impact against static and kinematic bodies instead of moving then pushing out
+	// fast bodies can't tunnel through thin platforms, most bodies resolve in one step
+	// integration still goes through integrateBatch(), the sweep starts from its output
+	bool sweepStatic = true;
+	// 16.16 integration, sweeps and contacts, for lockstep and replays (see fix32)
+	// - BodyRectAligned::box and vel are rebuilt from the fixed state after each update, writing them
+	//   from gameplay code requantizes the body
+	// - the float SIMD kernels are bypassed, the broadphase still runs on floats since it only
+	//   selects candidates (float conversion is monotonic so no fixed overlap is missed)
+	bool fixedPoint = false;
 	lsk_DSparseArray<BodyRectAligned> bodiesDynamic;
 	lsk_DSparseArray<BodyRectAligned> bodiesStatic;
+	lsk_DSparseArray<BodyRectAligned> bodiesKinematic; // static bodies moved by gameplay code
+
+	// one grid per layer, pairs whose masks exclude each other are never enumerated
+	BroadphaseGrid _gridDynamic[PHYSICS_MAX_LAYERS];
+	u32 _dynamicLayers = 0; // layers whose grid is initialized
+	BroadphaseGrid _gridKinematic;
+	StaticTree _staticTree;
+	bool _staticTreeDirty = true; // rebuilt by the next update or query
+	bool _staticChanged = false; // next update wakes every dynamic body
+
+	// solver state, indexed by body data id and swap-removed along with the body
+	// the SoA boxes are authoritative during update(), bodies are synced when gameplay code writes them
+	BodyArraySoA _dynamicSoA;
+	BodyArraySoA _kinematicSoA;
+	lsk_DArray<BodyBroadphase> _broadDynamic;
+	lsk_DArray<BodyBroadphase> _broadKinematic;
+	lsk_DArray<BodySleep> _sleepDynamic;
+	lsk_DArray<BodyFixed> _fixDynamic;
+	lsk_DArray<BodyFixed> _fixStatic;
+	lsk_DArray<BodyFixed> _fixKinematic;
+
+	NarrowphaseScratch _scratch[JOBS_MAX_THREADS]; // by JobPool::threadId()
+	lsk_DArray<i32> _stepIds; // dynamic data ids tested by the current narrowphase pass
+
+	lsk_DArray<f32> _gravityScale; // 1 awake, 0 sleeping, one per _dynamicSoA lane
+	BodyArraySoA _sweepStart; // boxes before integration, read by the sweep
+	lsk_DArray<i32> _awakeIds; // dynamic data ids integrated and resolved this tick
+	lsk_DArray<i32> _islandParent;
+	lsk_DArray<u8> _islandFlags;
+	f32 _sweepDelta = 0;
+	fix32 _fixDelta = 0;
+	fix32 _fixGravityX = 0, _fixGravityY = 0;
 
 	void init();
 	void destroy();
 
+	Ref<BodyRectAligned> addDynamic(const BodyRectAligned& body);
+	Ref<BodyRectAligned> addStatic(const BodyRectAligned& body);
+	Ref<BodyRectAligned> addKinematic(const BodyRectAligned& body);
+	void removeDynamic(Ref<BodyRectAligned>& ref);
+	void removeStatic(Ref<BodyRectAligned>& ref);
+	void removeKinematic(Ref<BodyRectAligned>& ref);
+
 	void update(f64 delta);
+
+	// write sleep state: game thread, not from a parallel system wave
+	void wake(BodyRectAligned& body);
+	void wakeInBox(const lsk_AABB2& box);
+
+	/**
+	 * Spatial queries, backed by the static tree and the grids
+	 * - call outside of update(), from any thread: each JobPool thread uses its own scratch
+	 * - read only, except the static tree rebuild after static bodies changed (asserts it is not
+	 *   called from a parallelFor() then)
+	 * - touching counts as overlapping, like intersectTest()
+	 * - dynamic and kinematic bodies are found where they were at the end of the last update,
+	 *   or when added, gameplay moves are picked up on the next update
+	 * - hits are appended in a deterministic order: static, kinematic, dynamic, by ref id
+	 */
+	u32 queryAABB(const lsk_AABB2& box, const QueryFilter& filter, lsk_DArray<QueryHit>* out);
+	u32 queryPoint(const lsk_Vec2& point, const QueryFilter& filter, lsk_DArray<QueryHit>* out);
+	// closest hit along the segment [from, to]
+	bool raycast(const lsk_Vec2& from, const lsk_Vec2& to, const QueryFilter& filter, RaycastHit* out);
+
+	void _syncGrid(const lsk_DSparseArray<BodyRectAligned>& bodies, BroadphaseGrid& grid,
+				   lsk_DArray<BodyBroadphase>& broad);
+	void _syncLayerGrids();
+	void _syncDynamic();
+	void _syncKinematic();
+	u32 _queryDynamic(NarrowphaseScratch& scratch, u32 layerMask, const GridRect& rect) const;
+	u32 _queryCandidates(NarrowphaseScratch& scratch, const lsk_DSparseArray<BodyRectAligned>& bodies,
+						 const BroadphaseGrid& grid, const GridRect& rect) const;
+	u32 _queryStaticHits(NarrowphaseScratch& scratch, const lsk_AABB2& box) const;
+	u32 _queryHits(NarrowphaseScratch& scratch, const BodyArraySoA& soa, const lsk_AABB2& box,
+				   u32 candidateCount) const;
+	void _queryStaticTree();
+	void _queryGrid(lsk_DSparseArray<BodyRectAligned>& bodies, const BroadphaseGrid& grid, u8 type,
+					const lsk_AABB2& box, const QueryFilter& filter, lsk_DArray<QueryHit>* out);
+	void _raycastGrid(lsk_DSparseArray<BodyRectAligned>& bodies, const BroadphaseGrid& grid, u8 type,
+					  const lsk_Vec2& from, const lsk_Vec2& to, const QueryFilter& filter, RaycastHit* best);
+	void _sweepBody(NarrowphaseScratch& scratch, i32 i, f32 delta);
+	void _narrowphase(NarrowphaseScratch& scratch, i32 i);
+	void _resolve(lsk_DArray<CollisionInfo>& collisions);
+	void _syncFixed(lsk_DSparseArray<BodyRectAligned>& bodies, lsk_DArray<BodyFixed>& fixed, bool isStatic);
+	void _integrateFixed(i32 i);
+	void _sweepBodyFixed(NarrowphaseScratch& scratch, i32 i);
+	void _narrowphaseFixed(NarrowphaseScratch& scratch, i32 i);
+	void _resolveFixed(lsk_DArray<CollisionInfo>& collisions);
+	void _mergeContacts(u32 threadCount, lsk_DArray<CollisionInfo>* collisions);
+	void _wake(i32 i);
+	i32 _islandFind(i32 i);
+	void _islandUnion(i32 a, i32 b);
+	void _updateSleep();
 };
 
 #define Physics PhysicsManager::get()
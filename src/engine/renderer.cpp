@@ -7,24 +7,26 @@
 
 #define MAKE_STR(something) #something
 
-// TODO: interpolation
-
 bool Shader_Color::loadAndinit()
 {
 	constexpr const char* colorVert = MAKE_STR(
 		#version 330 core\n
 		layout(location = 0) in vec2 position;\n
-		layout(location = 2) in mat4 model;\n
+		layout(location = 2) in vec2 instPos;\n
+		layout(location = 3) in vec2 instSize;\n
+		layout(location = 4) in float instAngle;\n
+		layout(location = 5) in uint instMatID;\n
 		uniform mat4 uViewMatrix;\n
-		uniform int uInstanceOffset;\n
-		uniform samplerBuffer uMatID;\n
 
 		flat out int vert_matID;\n
 
 		void main()\n
 		{\n
-		   vert_matID = int(texelFetch(uMatID, gl_InstanceID + uInstanceOffset).r * 65535); // un-normalize to get the proper ID\n
-		   gl_Position = uViewMatrix * model * vec4(position, 0.0, 1.0);\n
+		   vert_matID = int(instMatID);\n
+		   vec2 p = position * instSize;\n
+		   float c = cos(instAngle);\n
+		   float s = sin(instAngle);\n
+		   gl_Position = uViewMatrix * vec4(instPos + vec2(c * p.x - s * p.y, s * p.x + c * p.y), 0.0, 1.0);\n
 		}
 	);
 
@@ -63,10 +65,8 @@ bool Shader_Color::loadAndinit()
 	if(!_program) return false;
 
 	_uViewMatrix = glGetUniformLocation(_program, "uViewMatrix");
-	_uMatID = glGetUniformLocation(_program, "uMatID");
-	_uInstanceOffset = glGetUniformLocation(_program, "uInstanceOffset");
 
-	if(_uViewMatrix == -1 || _uMatID == -1 || _uInstanceOffset == -1) {
+	if(_uViewMatrix == -1) {
 		lsk_errf("[MaterialType_Flat] Error: failed to locate all uniforms");
 		return false;
 	}
@@ -92,16 +92,6 @@ void Shader_Color::setView(const lsk_Mat4& viewMatrix)
 	glUniformMatrix4fv(_uViewMatrix, 1, GL_FALSE, viewMatrix.data);
 }
 
-void Shader_Color::setMaterialIDBufferTextureSlot(u32 slot)
-{
-	glUniform1i(_uMatID, slot);
-}
-
-void Shader_Color::setInstanceOffset(i32 offset)
-{
-	glUniform1i(_uInstanceOffset, offset);
-}
-
 void Shader_Textured::Material::setTexture(u32 textureNameHash)
 {
 	texNameHash_layerID = textureNameHash;
@@ -113,10 +103,11 @@ bool Shader_Textured::loadAndInit()
 		#version 330 core\n
 		layout(location = 0) in vec2 position;\n
 		layout(location = 1) in vec2 uv;\n
-		layout(location = 2) in mat4 model;\n
+		layout(location = 2) in vec2 instPos;\n
+		layout(location = 3) in vec2 instSize;\n
+		layout(location = 4) in float instAngle;\n
+		layout(location = 5) in uint instMatID;\n
 		uniform mat4 uViewMatrix;\n
-		uniform int uInstanceOffset;\n
-		uniform samplerBuffer uMatID;\n
 
 		out vec2 vert_uv;\n
 		flat out int vert_matID;\n
@@ -124,8 +115,11 @@ bool Shader_Textured::loadAndInit()
 		void main()\n
 		{\n
 			vert_uv = uv;\n
-			vert_matID = int(texelFetch(uMatID, gl_InstanceID + uInstanceOffset).r * 65535); // un-normalize to get the proper ID\n
-			gl_Position = uViewMatrix * model * vec4(position, 0.0, 1.0);\n
+			vert_matID = int(instMatID);\n
+			vec2 p = position * instSize;\n
+			float c = cos(instAngle);\n
+			float s = sin(instAngle);\n
+			gl_Position = uViewMatrix * vec4(instPos + vec2(c * p.x - s * p.y, s * p.x + c * p.y), 0.0, 1.0);\n
 		}
 	);
 
@@ -178,13 +172,11 @@ bool Shader_Textured::loadAndInit()
 	if(!_program) return false;
 
 	_uViewMatrix = glGetUniformLocation(_program, "uViewMatrix");
-	_uMatID = glGetUniformLocation(_program, "uMatID");
-	_uInstanceOffset = glGetUniformLocation(_program, "uInstanceOffset");
 	_uTextureArray[0] = glGetUniformLocation(_program, "uTextureArray[0]");
 	_uTextureArray[1] = glGetUniformLocation(_program, "uTextureArray[1]");
 	_uTextureArray[2] = glGetUniformLocation(_program, "uTextureArray[2]");
 
-	if(_uViewMatrix == -1 || _uMatID == -1 || _uInstanceOffset == -1 ||
+	if(_uViewMatrix == -1 ||
 	   _uTextureArray[0] == -1 || _uTextureArray[1] == -1 || _uTextureArray[2] == -1) {
 		lsk_errf("[MaterialType_FlatTextured] Error: failed to locate all uniforms");
 		return false;
@@ -230,16 +222,6 @@ void Shader_Textured::setView(const lsk_Mat4& viewMatrix)
 	glUniformMatrix4fv(_uViewMatrix, 1, GL_FALSE, viewMatrix.data);
 }
 
-void Shader_Textured::setMaterialIDBufferTextureSlot(u32 slot)
-{
-	glUniform1i(_uMatID, slot);
-}
-
-void Shader_Textured::setInstanceOffset(i32 offset)
-{
-	glUniform1i(_uInstanceOffset, offset);
-}
-
 void Shader_Textured::setTextureArraySlots(i32* slots_, u32 count)
 {
 	for(u32 i = 0; i < count; ++i) {
@@ -252,12 +234,15 @@ void MaterialManager::init()
 	_allocMatData.init(&AllocDefault, Megabyte(5));
 	_dataMap.init(256, &_allocMatData);
 	_typeMap.init(256);
+	_idMap.init(256);
+	_idCount = 0;
 }
 
 void MaterialManager::destroy()
 {
 	_dataMap.destroy();
 	_typeMap.destroy();
+	_idMap.destroy();
 	_allocMatData.release();
 }
 
@@ -282,9 +267,145 @@ void DrawCommand::setMaterial(u32 nameHash)
 	// TODO: This can be easily invalidated if the material hash map grows
 	// after this draw command is created
 	_pMaterialData = Renderer.materials.getAnyData(nameHash);
+	_materialId = Renderer.materials.getId(nameHash);
+}
+
+void DrawCommand::setTransform(const lsk_Vec2& pos, const lsk_Vec2& size, f32 angle, const lsk_Vec2& origin)
+{
+	// rotate(angle) * translate(-origin) == translate(-rotated origin) * rotate(angle)
+	const f32 c = cosf(angle);
+	const f32 s = sinf(angle);
+	instance.pos[0] = pos.x - (c * origin.x - s * origin.y);
+	instance.pos[1] = pos.y - (s * origin.x + c * origin.y);
+	instance.size[0] = size.x;
+	instance.size[1] = size.y;
+	instance.angle = angle;
+}
+
+// z | vao | material type | material id, high to low: the draw order
+static inline u64 drawSortKey(const DrawCommand& cmd)
+{
+	assert(cmd.z >= -I16_MAX - 1 && cmd.z <= I16_MAX);
+	assert(cmd.vao <= 0xffff && cmd._materialId <= 0x3fffffff);
+	return ((u64)(u16)(cmd.z + I16_MAX + 1) << 48) |
+		   ((u64)(cmd.vao & 0xffff) << 32) |
+		   ((u64)((i32)cmd._materialType + 1) << 30) |
+		   (u64)(cmd._materialId & 0x3fffffff);
+}
+
+/**
+ * LSD radix sort of (key, id) pairs, 8 bits per pass, stable
+ * - passes where every key has the same byte are skipped
+ * - returns the sorted ids, either ids or tmpIds
+ */
+static u32* radixSortKeys(u64* keys, u32* ids, u64* tmpKeys, u32* tmpIds, u32 count)
+{
+	u32 histograms[8][256] = {};
+	for(u32 i = 0; i < count; ++i) {
+		const u64 key = keys[i];
+		for(u32 b = 0; b < 8; ++b) {
+			++histograms[b][(key >> (b * 8)) & 0xff];
+		}
+	}
+
+	for(u32 b = 0; b < 8; ++b) {
+		u32* hist = histograms[b];
+		const u32 shift = b * 8;
+		if(hist[(keys[0] >> shift) & 0xff] == count) {
+			continue;
+		}
+
+		u32 offset = 0;
+		for(u32 d = 0; d < 256; ++d) {
+			const u32 c = hist[d];
+			hist[d] = offset;
+			offset += c;
+		}
+
+		for(u32 i = 0; i < count; ++i) {
+			const u32 dst = hist[(keys[i] >> shift) & 0xff]++;
+			tmpKeys[dst] = keys[i];
+			tmpIds[dst] = ids[i];
+		}
+		lsk_swap(keys, tmpKeys);
+		lsk_swap(ids, tmpIds);
+	}
+	return ids;
+}
+
+void FramePacket::init()
+{
+	instances.init(2048);
+	groups.init(256);
+	flatData.init(256);
+	texturedData.init(256);
+	interpPos.init(2048);
+	interpKeys.init(2048);
 }
 
-bool RendererSingle::init()
+void FramePacket::destroy()
+{
+	instances.destroy();
+	groups.destroy();
+	flatData.destroy();
+	texturedData.destroy();
+	interpPos.destroy();
+	interpKeys.destroy();
+}
+
+void FramePacket::clear()
+{
+	instances.clear();
+	groups.clear();
+	flatData.clear();
+	texturedData.clear();
+	interpPos.clear();
+	interpKeys.clear();
+}
+
+bool RendererSingle::init(RendererBackend backend)
+{
+	_backend = backend;
+	if(_backend == RendererBackend::OPENGL) {
+		if(!_initGpu()) {
+			return false;
+		}
+	}
+	else {
+		_quadVao = 1; // queue() wants a vao
+	}
+
+	materials.init();
+
+	for(auto& frame: _frames) {
+		for(u32 l = 0; l < RENDERER_DRAW_LISTS; ++l) {
+			frame.lists[l].init(l == 0 ? 2048 : 256);
+		}
+		frame.order.init(2048);
+	}
+	_writeFrame = 0;
+
+	for(auto& packet: _packets) {
+		packet.init();
+	}
+	_packetLatest = -1;
+	_packetPrev = -1;
+	_renderCur = -1;
+	_renderPrev = -1;
+	_tick = 0;
+	_gpuTick = 0;
+	_renderInstances.init(2048);
+	_packetMatSlots.init(256);
+	_packetFillId = 0;
+	_staticBatchCount = 0;
+	_staticBatchUploaded = 0;
+
+	_viewPos = {0, 0};
+
+	return true;
+}
+
+bool RendererSingle::_initGpu()
 {
 	f32 vertices[] = {
 		0.f, 0.f,
@@ -344,14 +465,14 @@ bool RendererSingle::init()
 		return false;
 	}
 
-	glGenBuffers(1, &_gpuModelMatrixBuff);
-	_gpuModelMatrixBuffSize = -1;
+	glGenBuffers(1, &_gpuInstanceBuff);
+	_gpuInstanceBuffSize = -1;
 
 	// material uniform block
 	glGenBuffers(1, &_flat_materialBuff);
 	glGenBuffers(1, &_textured_materialBuff);
 
-	u32 blockPointIndex = 0;
+	u32 blockPointIndex = BlockPoint::COLOR_MATERIALS;
 	_flat_materialBuffSize = Megabyte(5);
 	glBindBuffer(GL_UNIFORM_BUFFER, _flat_materialBuff);
 	glBufferData(GL_UNIFORM_BUFFER, _flat_materialBuffSize, nullptr, GL_DYNAMIC_DRAW);
@@ -359,7 +480,7 @@ bool RendererSingle::init()
 	glUniformBlockBinding(_materialType_color._program, _materialType_color._uMaterialData,
 						  blockPointIndex);
 
-	blockPointIndex = 1;
+	blockPointIndex = BlockPoint::TEXTURED_MATERIALS;
 	_textured_materialBuffSize = Megabyte(5);
 	glBindBuffer(GL_UNIFORM_BUFFER, _textured_materialBuff);
 	glBufferData(GL_UNIFORM_BUFFER, _textured_materialBuffSize, nullptr, GL_DYNAMIC_DRAW);
@@ -367,23 +488,6 @@ bool RendererSingle::init()
 	glUniformBlockBinding(_materialType_textured._program, _materialType_textured._uMaterialData,
 						  blockPointIndex);
 
-	// material ID buffer
-	glGenTextures(1, &_materialIDBuffText);
-	glGenBuffers(1, &_materialIDBuff);
-
-	_materialIDBuffSize = sizeof(u16) * 256;
-	glBindBuffer(GL_TEXTURE_BUFFER, _materialIDBuff);
-	glBufferData(GL_TEXTURE_BUFFER, _materialIDBuffSize, nullptr, GL_DYNAMIC_DRAW);
-
-	_materialIDBuffTextSlot = Textures._gpuNextActiveTextureSlot++;
-	glActiveTexture(GL_TEXTURE0 + _materialIDBuffTextSlot);
-	glBindTexture(GL_TEXTURE_BUFFER, _materialIDBuffText);
-	glTexBuffer(GL_TEXTURE_BUFFER, GL_R16, _materialIDBuff);
-
-	materials.init();
-
-	_viewPosMatrix = lsk_Mat4Identity();
-
 	return true;
 }
 
@@ -391,136 +495,298 @@ void RendererSingle::destroy()
 {
 	materials.destroy();
 
-	glDeleteBuffers(1, &_quadVertexBuff);
-	glDeleteBuffers(1, &_quadIndexBuff);
-	glDeleteVertexArrays(1, &_quadVao);
+	if(_backend == RendererBackend::OPENGL) {
+		glDeleteBuffers(1, &_quadVertexBuff);
+		glDeleteBuffers(1, &_quadIndexBuff);
+		glDeleteVertexArrays(1, &_quadVao);
+	}
 
-	_drawCmdGroupCount.destroy();
-	_drawCmdList.destroy();
+	for(auto& frame: _frames) {
+		for(auto& list: frame.lists) {
+			list.destroy();
+		}
+		frame.order.destroy();
+	}
+
+	for(auto& packet: _packets) {
+		packet.destroy();
+	}
+	_renderInstances.destroy();
+	_packetMatSlots.destroy();
+
+	const u32 staticBatchCount = _staticBatchCount.load();
+	for(u32 b = 0; b < staticBatchCount; ++b) {
+		StaticBatch& batch = _staticBatches[b];
+		if(_backend == RendererBackend::OPENGL && b < _staticBatchUploaded) {
+			glDeleteBuffers(1, &batch.instanceBuff);
+			glDeleteBuffers(1, &batch.materialBuff);
+		}
+		batch.instances.destroy();
+		batch.materials.destroy();
+	}
+	_staticBatchCount = 0;
+	_staticBatchUploaded = 0;
 }
 
 void RendererSingle::viewResize(i32 width, i32 height, f32 zoom)
 {
 	_orthoMatrix = lsk_Mat4Orthographic(0, width * zoom, height * zoom, 0, -1, 1);
+	_viewSize = {width * zoom, height * zoom};
 }
 
 void RendererSingle::viewSetPos(f32 x, f32 y)
 {
-	_viewPosMatrix = lsk_Mat4Translate({-x, -y, 0});
+	_viewPos = {x, y};
 }
 
 void RendererSingle::beginFrame()
 {
-	_drawCmdGroupCount.clear();
-	_drawCmdList.clear();
-	_listMutex.unlock(); // everything is rendered, unlock
+	// not the one endFrame() is sorting, that one is behind
+	DrawFrame& frame = _frames[_writeFrame.load(std::memory_order_relaxed)];
+	for(auto& list: frame.lists) {
+		list.clear();
+	}
+	frame.order.clear();
 }
 
 void RendererSingle::endFrame()
 {
-	_listMutex.lock(); // lock list until we rendered it
+	// every queue() of this frame returned, the next ones go to the other frame
+	const u32 frameId = _writeFrame.load(std::memory_order_relaxed);
+	_writeFrame.store(frameId ^ 1, std::memory_order_release);
+
+	const i32 packetId = _acquirePacket();
+	FramePacket& packet = _packets[packetId];
+	packet.clear();
+	packet.orthoMatrix = _orthoMatrix;
+	packet.viewPos = _viewPos;
+	packet.viewSize = _viewSize;
+	_fillPacket(_frames[frameId], packet);
+	_publishPacket(packetId);
+}
 
-	const u32 drawCmdCount = _drawCmdList.count();
+void RendererSingle::_fillPacket(DrawFrame& frame, FramePacket& packet)
+{
+	u32 drawCmdCount = 0;
+	for(const auto& list: frame.lists) {
+		drawCmdCount += list.count();
+	}
 	if(drawCmdCount == 0) return; // nothing to do here
 
-	// sort by vao, material
-	auto compare = [](const void* pa, const void* pb) -> i32 {
-		DrawCommand& a = *(DrawCommand*)pa;
-		DrawCommand& b = *(DrawCommand*)pb;
-
-		if(a.z < b.z) {
-			return -1;
+	// sort (key, id) pairs, commands stay in place
+	lsk_Block sortBlock = _pAlloc->allocate((sizeof(u64) + sizeof(u32)) * 2 * drawCmdCount, alignof(u64));
+	assert_msg(sortBlock.ptr, "Out of memory");
+	u64* keys = (u64*)sortBlock.ptr;
+	u64* tmpKeys = keys + drawCmdCount;
+	u32* ids = (u32*)(tmpKeys + drawCmdCount);
+	u32* tmpIds = ids + drawCmdCount;
+	u32 k = 0;
+	for(u32 l = 0; l < RENDERER_DRAW_LISTS; ++l) {
+		const auto& list = frame.lists[l];
+		assert(list.count() <= (1u << RENDERER_DRAW_ID_BITS));
+		for(u32 i = 0; i < list.count(); ++i, ++k) {
+			keys[k] = list[i]._sortKey;
+			ids[k] = l << RENDERER_DRAW_ID_BITS | i;
 		}
-		if(a.z > b.z) {
-			return 1;
-		}
-		if(a.vao < b.vao) {
-			return -1;
-		}
-		if(a.vao > b.vao) {
-			return 1;
-		}
-		if(a._materialType < b._materialType) {
-			return -1;
+	}
+
+	const u32* sortedIds = radixSortKeys(keys, ids, tmpKeys, tmpIds, drawCmdCount);
+	frame.order.reserve(drawCmdCount);
+	for(u32 i = 0; i < drawCmdCount; ++i) {
+		frame.order.push(sortedIds[i]);
+	}
+	_pAlloc->deallocate(sortBlock);
+
+	// a material is copied once per packet (the simulation keeps changing them)
+	// up to RENDERER_MATERIAL_MAX per page, a full page starts a new one and a new group
+	++_packetFillId;
+	while(_packetMatSlots.count() < materials._idCount) {
+		_packetMatSlots.push({0, 0});
+	}
+	u32 pageStart[2] = {0, 0}; // by material type, in the packet material data
+
+	// groups of the same vao, material type and page, drawn instanced
+	packet.instances.reserve(drawCmdCount);
+	packet.interpPos.reserve(drawCmdCount);
+
+	DrawGroup* pCurGroup = nullptr;
+	for(u32 id: frame.order) {
+		const DrawCommand& cmd = frame.get(id);
+		if(cmd.staticBatch) {
+			packet.groups.push({cmd.vao, cmd._materialType, 0, cmd.staticBatch, 0});
+			pCurGroup = nullptr;
+			continue;
 		}
-		if(a._materialType > b._materialType) {
-			return 1;
+
+		const i32 type = (i32)cmd._materialType;
+		assert(type == (i32)MaterialType::COLOR || type == (i32)MaterialType::TEXTURED);
+		PacketMaterialSlot& slot = _packetMatSlots[cmd._materialId];
+		if(slot.fillId != _packetFillId || slot.index < pageStart[type]) {
+			const u32 count = cmd._materialType == MaterialType::COLOR ? packet.flatData.count() :
+																		packet.texturedData.count();
+			if(count - pageStart[type] == RENDERER_MATERIAL_MAX) {
+				pageStart[type] = count;
+				pCurGroup = nullptr;
+			}
+			if(cmd._materialType == MaterialType::COLOR) {
+				packet.flatData.push(*(Shader_Color::Material*)cmd._pMaterialData);
+			}
+			else {
+				packet.texturedData.push(*(Shader_Textured::Material*)cmd._pMaterialData);
+			}
+			slot = {_packetFillId, count};
 		}
-		if(a._pMaterialData < b._pMaterialData) {
-			return -1;
+
+		const u32 page = pageStart[type] / RENDERER_MATERIAL_MAX;
+		if(!pCurGroup || pCurGroup->vao != cmd.vao || pCurGroup->materialType != cmd._materialType ||
+		   pCurGroup->materialPage != page) {
+			pCurGroup = &packet.groups.push({cmd.vao, cmd._materialType, 1, 0, page});
 		}
-		if(a._pMaterialData > b._pMaterialData) {
-			return 1;
+		else {
+			++pCurGroup->count;
 		}
-		return 0;
-	};
 
-	qsort(_drawCmdList.data(), drawCmdCount, sizeof(DrawCommand), compare);
+		if(cmd.interpId) {
+			packet.interpKeys.push((u64)cmd.interpId << 32 | packet.instances.count());
+		}
+		packet.instances.push(cmd.instance).matID = (u16)(slot.index - pageStart[type]);
+		packet.interpPos.push(cmd.interpPos);
+	}
 
-	// TODO: makes groups, draw instanced, make a Modelmatrix buffer
-	u32 curVao = _drawCmdList[0].vao;
-	MaterialType pCurMatType = _drawCmdList[0]._materialType;
-	u32* pCurCount = &_drawCmdGroupCount.push(0);
+	std::sort(packet.interpKeys.data(), packet.interpKeys.data() + packet.interpKeys.count());
+}
 
-	for(const auto& cmd: _drawCmdList) {
-		if(curVao != cmd.vao || pCurMatType != cmd._materialType) {
-			pCurCount = &_drawCmdGroupCount.push(1);
-			curVao = cmd.vao;
-			pCurMatType = cmd._materialType;
-		}
-		else {
-			++(*pCurCount);
+i32 RendererSingle::_acquirePacket()
+{
+	std::lock_guard<std::mutex> lock(_packetMutex);
+	for(i32 i = 0; i < RENDERER_PACKETS; ++i) {
+		if(i != _packetLatest && i != _packetPrev && i != _renderCur && i != _renderPrev) {
+			return i;
 		}
 	}
+	assert_msg(0, "No free frame packet");
+	return 0;
+}
 
-	i32 modelMatrixBuffSize = sizeof(lsk_Mat4) * drawCmdCount;
-	lsk_Block modelMatrixBlock = _pAlloc->allocate(modelMatrixBuffSize, alignof(lsk_Mat4));
-	lsk_Mat4* modelMatrices = (lsk_Mat4*)modelMatrixBlock.ptr;
+void RendererSingle::_publishPacket(i32 packetId)
+{
+	_packets[packetId].tick = ++_tick;
+	std::lock_guard<std::mutex> lock(_packetMutex);
+	_packetPrev = _packetLatest;
+	_packetLatest = packetId;
+}
 
-	// TODO: move _drawCmdList[i].modelMatrix to a separate array? how is sort handled then?
-	for(u32 i = 0; i < drawCmdCount; ++i) {
-		modelMatrices[i] = _drawCmdList[i].modelMatrix;
-	}
+void RendererSingle::queue(const DrawCommand& cmd)
+{
+	assert(cmd.vao > 0 && cmd._materialType != MaterialType::INVALID && (cmd._pMaterialData || cmd.staticBatch));
+	// only this thread appends to this list
+	DrawFrame& frame = _frames[_writeFrame.load(std::memory_order_acquire)];
+	frame.lists[JobPool::threadId()].push(cmd)._sortKey = drawSortKey(cmd);
+}
+
+void RendererSingle::queueSprite(u32 materialNameHash, i32 z, const lsk_Vec2& pos,
+								 const lsk_Vec2& size, const lsk_Quat& rot)
+{
+	DrawCommand cmd;
+	cmd.vao = Renderer._quadVao;
+	cmd.z = z;
+	cmd.setTransform(pos, size, quatAngle2D(rot));
+	cmd.setMaterial(materialNameHash);
+	queue(cmd);
+}
 
-	// upload model matrices to gpu
-	glBindBuffer(GL_ARRAY_BUFFER, _gpuModelMatrixBuff);
-	if(_gpuModelMatrixBuffSize < modelMatrixBuffSize) {
-		glBufferData(GL_ARRAY_BUFFER, modelMatrixBuffSize, modelMatrixBlock.ptr, GL_DYNAMIC_DRAW);
-		_gpuModelMatrixBuffSize = modelMatrixBuffSize;
+u32 RendererSingle::createStaticBatch(const Instance2D* instances, u32 instanceCount,
+									 const Shader_Textured::Material* materials, u32 materialCount)
+{
+	assert(instanceCount > 0 && materialCount <= RENDERER_MATERIAL_MAX);
+	// only the simulation thread creates batches, render() only reads counted ones
+	const u32 batchId = _staticBatchCount.load(std::memory_order_relaxed);
+	assert_msg(batchId < RENDERER_STATIC_BATCH_MAX, "Too many static batches");
+	StaticBatch& batch = _staticBatches[batchId];
+
+	batch.instances.init(instanceCount);
+	batch.materials.init(lsk_max(materialCount, 1u));
+	batch.boundsMin = {instances[0].pos[0], instances[0].pos[1]};
+	batch.boundsMax = batch.boundsMin;
+	for(u32 i = 0; i < instanceCount; ++i) {
+		const Instance2D& inst = batch.instances.push(instances[i]);
+		assert(inst.matID < materialCount);
+		// rotated: anything within size of pos
+		const f32 ext = inst.angle == 0.f ? 0.f : lsk_abs(inst.size[0]) + lsk_abs(inst.size[1]);
+		const f32 minX = lsk_min(inst.pos[0], inst.pos[0] + inst.size[0]) - ext;
+		const f32 minY = lsk_min(inst.pos[1], inst.pos[1] + inst.size[1]) - ext;
+		const f32 maxX = lsk_max(inst.pos[0], inst.pos[0] + inst.size[0]) + ext;
+		const f32 maxY = lsk_max(inst.pos[1], inst.pos[1] + inst.size[1]) + ext;
+		batch.boundsMin = {lsk_min(batch.boundsMin.x, minX), lsk_min(batch.boundsMin.y, minY)};
+		batch.boundsMax = {lsk_max(batch.boundsMax.x, maxX), lsk_max(batch.boundsMax.y, maxY)};
 	}
-	else {
-		glBufferSubData(GL_ARRAY_BUFFER, 0, modelMatrixBuffSize, modelMatrixBlock.ptr);
+	for(u32 m = 0; m < materialCount; ++m) {
+		batch.materials.push(materials[m]);
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	_pAlloc->deallocate(modelMatrixBlock);
+	_staticBatchCount.store(batchId + 1, std::memory_order_release);
+	return batchId;
+}
 
-	lsk_DArray<Shader_Color::Material> flatData(256);
-	lsk_DArray<Shader_Textured::Material> texturedData(256);
-	lsk_DArray<u16> matIDs(_drawCmdList.count());
+void RendererSingle::queueStatic(u32 batchId, i32 z)
+{
+	assert(batchId < _staticBatchCount.load(std::memory_order_relaxed));
+	DrawCommand cmd;
+	cmd.vao = _quadVao;
+	cmd.z = z;
+	cmd._materialType = MaterialType::TEXTURED;
+	cmd._materialId = 0;
+	cmd.staticBatch = batchId + 1;
+	queue(cmd);
+}
 
-	const void* curMatDataPtr = nullptr;
-	i32 curMatID = 0;
-	for(const auto& cmd: _drawCmdList) {
-		if(cmd._materialType == MaterialType::COLOR &&
-		   curMatDataPtr != cmd._pMaterialData) {
-			flatData.push(*(Shader_Color::Material*)cmd._pMaterialData);
-			curMatID = flatData.count() - 1;
-			curMatDataPtr = cmd._pMaterialData;
-		}
+static inline lsk_Vec2 lerpSnap(const lsk_Vec2& from, const lsk_Vec2& to, f32 alpha)
+{
+	const lsk_Vec2 d = to - from;
+	if(lsk_abs(d.x) > RENDERER_INTERP_SNAP_DIST || lsk_abs(d.y) > RENDERER_INTERP_SNAP_DIST) {
+		return to;
+	}
+	return from + d * alpha;
+}
 
-		if(cmd._materialType == MaterialType::TEXTURED &&
-		   curMatDataPtr != cmd._pMaterialData) {
-			texturedData.push(*(Shader_Textured::Material*)cmd._pMaterialData);
-			curMatID = texturedData.count() - 1;
-			curMatDataPtr = cmd._pMaterialData;
-		}
+lsk_Vec2 RendererSingle::_interpolate(const FramePacket& cur, const FramePacket* pPrev, f32 alpha)
+{
+	_renderInstances.clear();
+	_renderInstances.reserve(cur.instances.count());
+	for(const auto& inst: cur.instances) {
+		_renderInstances.push(inst);
+	}
 
-		matIDs.push(curMatID);
+	// only from the tick right before, a skipped tick would make things jump back
+	if(!pPrev || pPrev->tick + 1 != cur.tick || alpha >= 1.f) {
+		return cur.viewPos;
 	}
 
-	// load required textures
-	lsk_DArray<u32> texHashToLoad(texturedData.count());
+	// both key arrays are sorted, walk them side by side
+	const u64* prevKey = pPrev->interpKeys.data();
+	const u64* prevEnd = prevKey + pPrev->interpKeys.count();
+	for(u64 key: cur.interpKeys) {
+		const u32 interpId = key >> 32;
+		while(prevKey != prevEnd && (*prevKey >> 32) < interpId) {
+			++prevKey;
+		}
+		if(prevKey == prevEnd) break;
+		if((*prevKey >> 32) != interpId) continue;
+
+		const u32 m = key & 0xffffffff;
+		const lsk_Vec2& to = cur.interpPos[m];
+		const lsk_Vec2 pos = lerpSnap(pPrev->interpPos[*prevKey & 0xffffffff], to, alpha);
+		_renderInstances[m].pos[0] += pos.x - to.x;
+		_renderInstances[m].pos[1] += pos.y - to.y;
+	}
+
+	return lerpSnap(pPrev->viewPos, cur.viewPos, alpha);
+}
+
+// loads the textures, texture name hashes become texture array layers
+static void resolveTextures(lsk_DArray<Shader_Textured::Material>& texturedData)
+{
+	lsk_DArray<u32> texHashToLoad(lsk_max(texturedData.count(), 1u));
 
 	for(auto& td: texturedData) {
 		texHashToLoad.push(td.texNameHash_layerID);
@@ -539,120 +805,208 @@ void RendererSingle::endFrame()
 		td.uvParams.z *= td.uvMax_x;
 		td.uvParams.w *= td.uvMax_y;
 	}
+}
+
+void RendererSingle::_upload(FramePacket& packet)
+{
+	// instances change every render() with alpha
+	i32 instanceBuffSize = sizeof(Instance2D) * _renderInstances.count();
+	glBindBuffer(GL_ARRAY_BUFFER, _gpuInstanceBuff);
+	if(_gpuInstanceBuffSize < instanceBuffSize) {
+		glBufferData(GL_ARRAY_BUFFER, instanceBuffSize, _renderInstances.data(), GL_DYNAMIC_DRAW);
+		_gpuInstanceBuffSize = instanceBuffSize;
+	}
+	else {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instanceBuffSize, _renderInstances.data());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+	// materials only once per packet
+	if(packet.tick == _gpuTick) return;
+	_gpuTick = packet.tick;
 
-	/*lsk_printf("Renderer:endFrame(): flatData.count()=%d matIDs.count()=%d",
-			   flatData.count(), matIDs.count());*/
+	auto& texturedData = packet.texturedData;
+	auto& flatData = packet.flatData;
+	resolveTextures(texturedData);
 
+	// one RENDERER_MATERIAL_MAX block per page, render() binds the page of each group
 	glBindBuffer(GL_UNIFORM_BUFFER, _flat_materialBuff);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0,
-					sizeof(Shader_Color::Material) * flatData.count(),
-					flatData.data());
+	for(u32 start = 0; start < flatData.count(); start += RENDERER_MATERIAL_MAX) {
+		const u32 count = lsk_min(flatData.count() - start, (u32)RENDERER_MATERIAL_MAX);
+		assert(count <= RENDERER_MATERIAL_MAX);
+		assert_msg(sizeof(Shader_Color::Material) * (start + RENDERER_MATERIAL_MAX) <= _flat_materialBuffSize,
+				   "Too many color materials in a frame");
+		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(Shader_Color::Material) * start,
+						sizeof(Shader_Color::Material) * count, flatData.data() + start);
+	}
 
 	glBindBuffer(GL_UNIFORM_BUFFER, _textured_materialBuff);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0,
-					sizeof(Shader_Textured::Material) * texturedData.count(),
-					texturedData.data());
+	for(u32 start = 0; start < texturedData.count(); start += RENDERER_MATERIAL_MAX) {
+		const u32 count = lsk_min(texturedData.count() - start, (u32)RENDERER_MATERIAL_MAX);
+		assert(count <= RENDERER_MATERIAL_MAX);
+		assert_msg(sizeof(Shader_Textured::Material) * (start + RENDERER_MATERIAL_MAX) <= _textured_materialBuffSize,
+				   "Too many textured materials in a frame");
+		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(Shader_Textured::Material) * start,
+						sizeof(Shader_Textured::Material) * count, texturedData.data() + start);
+	}
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void RendererSingle::_uploadStatic(StaticBatch& batch)
+{
+	resolveTextures(batch.materials);
 
-	u64 matIDBuffSize = matIDs.count() * sizeof(u16);
-	glBindBuffer(GL_TEXTURE_BUFFER, _materialIDBuff);
-	if(_materialIDBuffSize < matIDBuffSize) {
-		glBufferData(GL_TEXTURE_BUFFER, matIDBuffSize, matIDs.data(), GL_DYNAMIC_DRAW);
-		_materialIDBuffSize = matIDBuffSize;
+	glGenBuffers(1, &batch.instanceBuff);
+	glBindBuffer(GL_ARRAY_BUFFER, batch.instanceBuff);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Instance2D) * batch.instances.count(), batch.instances.data(),
+				 GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// the whole block size, it's bound in place of the frame materials
+	glGenBuffers(1, &batch.materialBuff);
+	glBindBuffer(GL_UNIFORM_BUFFER, batch.materialBuff);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Shader_Textured::Material) * RENDERER_MATERIAL_MAX, nullptr,
+				 GL_STATIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Shader_Textured::Material) * batch.materials.count(),
+					batch.materials.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void RendererSingle::_bindMaterialPage(MaterialType type, u32 page)
+{
+	// page sizes (8KB, 24KB) are multiples of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	if(type == MaterialType::COLOR) {
+		const u64 pageSize = sizeof(Shader_Color::Material) * RENDERER_MATERIAL_MAX;
+		glBindBufferRange(GL_UNIFORM_BUFFER, BlockPoint::COLOR_MATERIALS, _flat_materialBuff,
+						  pageSize * page, pageSize);
 	}
-	else {
-		glBufferSubData(GL_TEXTURE_BUFFER, 0, matIDBuffSize, matIDs.data());
+	else if(type == MaterialType::TEXTURED) {
+		const u64 pageSize = sizeof(Shader_Textured::Material) * RENDERER_MATERIAL_MAX;
+		glBindBufferRange(GL_UNIFORM_BUFFER, BlockPoint::TEXTURED_MATERIALS, _textured_materialBuff,
+						  pageSize * page, pageSize);
 	}
-	glBindBuffer(GL_TEXTURE_BUFFER, 0);
 }
 
-void RendererSingle::queue(const DrawCommand& cmd)
+void RendererSingle::_useMaterialType(MaterialType type, const lsk_Mat4& viewMat)
 {
-	assert(cmd.vao > 0 && cmd._materialType != MaterialType::INVALID && cmd._pMaterialData);
-	_listMutex.lock();
-	_drawCmdList.push(cmd);
-	_listMutex.unlock();
+	if(type == MaterialType::COLOR) {
+		_materialType_color.use();
+		_materialType_color.setView(viewMat);
+	}
+	else if(type == MaterialType::TEXTURED) {
+		_materialType_textured.use();
+		_materialType_textured.setView(viewMat);
+		i32 slots_[] = {
+			Textures._textureArray[0].slot,
+			Textures._textureArray[1].slot,
+			Textures._textureArray[2].slot
+		};
+		_materialType_textured.setTextureArraySlots(slots_, 3);
+	}
 }
 
-void RendererSingle::queueSprite(u32 materialNameHash, i32 z, const lsk_Vec2& pos,
-								 const lsk_Vec2& size, const lsk_Quat& rot)
+void RendererSingle::_setInstanceAttribs(u64 baseOffset)
 {
-	DrawCommand cmd;
-	lsk_Mat4 model = lsk_Mat4Translate({pos, 0});
-	if(!lsk_QuatIsNull(rot)) {
-		model = model * lsk_QuatMatrix(rot);
+	const u32 stride = sizeof(Instance2D);
+	glVertexAttribPointer(Layout::INSTANCE_POS, 2, GL_FLOAT, GL_FALSE, stride,
+						  (void*)(baseOffset + offsetof(Instance2D, pos)));
+	glVertexAttribPointer(Layout::INSTANCE_SIZE, 2, GL_FLOAT, GL_FALSE, stride,
+						  (void*)(baseOffset + offsetof(Instance2D, size)));
+	glVertexAttribPointer(Layout::INSTANCE_ANGLE, 1, GL_FLOAT, GL_FALSE, stride,
+						  (void*)(baseOffset + offsetof(Instance2D, angle)));
+	// integer attribute, no float conversion
+	glVertexAttribIPointer(Layout::INSTANCE_MATID, 1, GL_UNSIGNED_SHORT, stride,
+						   (void*)(baseOffset + offsetof(Instance2D, matID)));
+
+	for(u32 i = Layout::INSTANCE_POS; i <= Layout::INSTANCE_MATID; ++i) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
 	}
-	model = model * lsk_Mat4Scale({size, 1});
-	cmd.vao = Renderer._quadVao;
-	cmd.z = z;
-	cmd.modelMatrix = model;
-	cmd.setMaterial(materialNameHash);
-	queue(cmd);
 }
 
-void RendererSingle::render()
+void RendererSingle::render(f32 alpha)
 {
-	if(_drawCmdList.count() == 0) return; // nothing to do here
+	{
+		// hold them until the next render(), endFrame() won't reuse them
+		std::lock_guard<std::mutex> lock(_packetMutex);
+		_renderCur = _packetLatest;
+		_renderPrev = _packetPrev;
+	}
+	if(_renderCur == -1) return;
+
+	FramePacket& packet = _packets[_renderCur];
+	const FramePacket* pPrev = _renderPrev != -1 ? &_packets[_renderPrev] : nullptr;
+	const lsk_Vec2 viewPos = _interpolate(packet, pPrev, alpha);
+
+	if(_backend == RendererBackend::NONE) return;
+
+	// batches created since the last render()
+	const u32 staticBatchCount = _staticBatchCount.load(std::memory_order_acquire);
+	for(; _staticBatchUploaded < staticBatchCount; ++_staticBatchUploaded) {
+		_uploadStatic(_staticBatches[_staticBatchUploaded]);
+	}
 
-	lsk_Mat4 viewMat = _orthoMatrix * _viewPosMatrix;
+	if(packet.groups.count() == 0) return; // nothing to do here
+
+	_upload(packet);
+
+	lsk_Mat4 viewMat = packet.orthoMatrix * lsk_Mat4Translate({-viewPos.x, -viewPos.y, 0});
+	const lsk_Vec2 viewMax = viewPos + packet.viewSize;
 
-	const DrawCommand* pCmd;
 	u32 curVao = 0;
 	MaterialType curMatType = MaterialType::INVALID;
-	u32 modelStartId = 0;
-
-	for(u32 groupCount: _drawCmdGroupCount) {
-		pCmd = &_drawCmdList[modelStartId];
-
-		if(curMatType != pCmd->_materialType) {
-			curMatType = pCmd->_materialType;
-			if(curMatType == MaterialType::COLOR) {
-				_materialType_color.use();
-				_materialType_color.setView(viewMat);
-				_materialType_color.setMaterialIDBufferTextureSlot(_materialIDBuffTextSlot);
-				_materialType_color.setInstanceOffset(modelStartId);
-			}
-			else if(curMatType == MaterialType::TEXTURED) {
-				_materialType_textured.use();
-				_materialType_textured.setView(viewMat);
-				_materialType_textured.setMaterialIDBufferTextureSlot(_materialIDBuffTextSlot);
-				_materialType_textured.setInstanceOffset(modelStartId);
-				i32 slots_[] = {
-					Textures._textureArray[0].slot,
-					Textures._textureArray[1].slot,
-					Textures._textureArray[2].slot
-				};
-				_materialType_textured.setTextureArraySlots(slots_, 3);
+	u32 instanceStartId = 0;
+	i32 boundPage[2] = {0, 0}; // by material type, -1: static batch materials
+
+	for(const DrawGroup& group: packet.groups) {
+		const StaticBatch* pStatic = nullptr;
+		if(group.staticBatch) {
+			pStatic = &_staticBatches[group.staticBatch - 1];
+			if(pStatic->boundsMax.x < viewPos.x || pStatic->boundsMin.x > viewMax.x ||
+			   pStatic->boundsMax.y < viewPos.y || pStatic->boundsMin.y > viewMax.y) {
+				continue; // out of view
 			}
 		}
 
-		if(curVao != pCmd->vao) {
-			curVao = pCmd->vao;
-			glBindVertexArray(pCmd->vao);
+		if(curMatType != group.materialType) {
+			curMatType = group.materialType;
+			_useMaterialType(curMatType, viewMat);
 		}
 
-		glBindBuffer(GL_ARRAY_BUFFER, _gpuModelMatrixBuff);
-
-		u32 stride = sizeof(lsk_Mat4);
-		u64 offset = sizeof(f32) * 4;
-		u64 baseOffset = modelStartId * sizeof(lsk_Mat4);
-
-		for(u32 i = 0; i < 4; ++i) {
-			glVertexAttribPointer(
-				Layout::MODEL + i,
-				4,
-				GL_FLOAT,
-				GL_FALSE,
-				stride,
-				(void*)(baseOffset + offset * i));
-			glEnableVertexAttribArray(Layout::MODEL + i);
-			glVertexAttribDivisor(Layout::MODEL + i, 1);
+		if(curVao != group.vao) {
+			curVao = group.vao;
+			glBindVertexArray(group.vao);
 		}
 
-		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, groupCount);
+		if(pStatic) {
+			// its own materials in place of the frame ones
+			glBindBufferBase(GL_UNIFORM_BUFFER, BlockPoint::TEXTURED_MATERIALS, pStatic->materialBuff);
+			boundPage[(i32)MaterialType::TEXTURED] = -1;
+			glBindBuffer(GL_ARRAY_BUFFER, pStatic->instanceBuff);
+			_setInstanceAttribs(0);
+			glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, pStatic->instances.count());
+			continue;
+		}
+
+		if(boundPage[(i32)group.materialType] != (i32)group.materialPage) {
+			_bindMaterialPage(group.materialType, group.materialPage);
+			boundPage[(i32)group.materialType] = group.materialPage;
+		}
 
-		modelStartId += groupCount;
+		glBindBuffer(GL_ARRAY_BUFFER, _gpuInstanceBuff);
+		_setInstanceAttribs(instanceStartId * sizeof(Instance2D));
+
+		glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL, group.count);
+
+		instanceStartId += group.count;
+	}
+
+	// the next render() starts from page 0
+	if(boundPage[(i32)MaterialType::COLOR] != 0) {
+		_bindMaterialPage(MaterialType::COLOR, 0);
+	}
+	if(boundPage[(i32)MaterialType::TEXTURED] != 0) {
+		_bindMaterialPage(MaterialType::TEXTURED, 0);
 	}
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
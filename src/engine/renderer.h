@@ -1,16 +1,22 @@
 #pragma once
 #include <lsk/lsk_math.h>
 #include <lsk/lsk_array.h>
-#include <lsk/lsk_thread.h>
-#include <external/gl3w.h>
 #include <external/gl3w.h>
+#include <atomic>
+#include <mutex>
+#include "jobs.h"
+
+#define RENDERER_DRAW_LISTS JOBS_MAX_THREADS // one append list per job thread
+#define RENDERER_DRAW_ID_BITS 24 // command index in its list, the list is in the bits above
+#define RENDERER_PACKETS 5 // latest and previous published, the two render() holds, one being built
+#define RENDERER_INTERP_SNAP_DIST 32.f // moved further than that in a tick: teleported, not interpolated
+#define RENDERER_STATIC_BATCH_MAX 256
+#define RENDERER_MATERIAL_MAX 512 // uMaterial[] size in the shaders
 
 struct Shader_Color
 {
 	GLuint _program = 0;
 	GLint _uViewMatrix = -1;
-	GLint _uMatID = -1;
-	GLint _uInstanceOffset = -1;
 	GLuint _uMaterialData = 0;
 
 	struct Material {
@@ -20,16 +26,12 @@ struct Shader_Color
 	bool loadAndinit();
 	void use();
 	void setView(const lsk_Mat4& viewMatrix);
-	void setMaterialIDBufferTextureSlot(u32 slot);
-	void setInstanceOffset(i32 offset);
 };
 
 struct Shader_Textured
 {
 	GLuint _program = 0;
 	GLint _uViewMatrix = -1;
-	GLint _uMatID = -1;
-	GLint _uInstanceOffset = -1;
 	GLint _uTextureArray[3];
 	GLuint _uMaterialData = 0;
 
@@ -47,8 +49,6 @@ struct Shader_Textured
 	bool loadAndInit();
 	void use();
 	void setView(const lsk_Mat4& viewMatrix);
-	void setMaterialIDBufferTextureSlot(u32 slot);
-	void setInstanceOffset(i32 offset);
 	void setTextureArraySlots(i32* slots_, u32 count);
 };
 
@@ -63,6 +63,8 @@ struct MaterialManager
 	lsk_AllocatorHeapCascade _allocMatData;
 	lsk_DStrHashMap<lsk_Block> _dataMap;
 	lsk_DStrHashMap<MaterialType> _typeMap;
+	lsk_DStrHashMap<u32> _idMap; // dense ids, in creation order
+	u32 _idCount = 0;
 
 	void init();
 	void destroy();
@@ -78,6 +80,9 @@ struct MaterialManager
 		new(block.ptr) MatT(material);
 		_dataMap.seth(materialNameHash, block);
 		_typeMap.seth(materialNameHash, type);
+		if(!_idMap.geth(materialNameHash)) {
+			_idMap.seth(materialNameHash, _idCount++);
+		}
 		return *(MatT*)block.ptr;
 	}
 
@@ -93,6 +98,12 @@ struct MaterialManager
 		return b->ptr;
 	}
 
+	inline u32 getId(u32 materialNameHash) {
+		u32* id = _idMap.geth(materialNameHash);
+		assert(id);
+		return *id;
+	}
+
 	inline bool exists(u32 materialNameHash) {
 		return (_typeMap.geth(materialNameHash) != nullptr);
 	}
@@ -101,17 +112,109 @@ struct MaterialManager
 	Shader_Textured::Material& getTextured(u32 materialNameHash);
 };
 
+// per instance vertex attributes: model = translate(pos) * rotate(angle) * scale(size)
+struct Instance2D
+{
+	f32 pos[2]; // origin already taken off (lsk_Vec2 is 16 bytes)
+	f32 size[2]; // negative flips
+	f32 angle = 0; // radians, around z
+	u16 matID = 0; // index in its group's material page, set by endFrame()
+	u16 _pad = 0;
+};
+
+static_assert(sizeof(Instance2D) == 24, "Instance2D must stay packed, it's uploaded as is");
+
+// rotation around z of a 2D quaternion
+inline f32 quatAngle2D(const lsk_Quat& q)
+{
+	return 2.f * atan2f(q.z, q.w);
+}
+
 struct DrawCommand
 {
 	MaterialType _materialType = MaterialType::INVALID;
 	const void* _pMaterialData = nullptr;
+	u32 _materialId = 0;
+	u64 _sortKey = 0; // set by RendererSingle::queue()
 	u32 vao = 0;
-	i32 z = 0;
-	lsk_Mat4 modelMatrix;
+	i32 z = 0; // [-32768, 32767]
+	Instance2D instance;
+	u32 interpId = 0; // same id across ticks gets interpolated, 0: never
+	lsk_Vec2 interpPos; // position interpolated for interpId, the model is moved by the difference
+	u32 staticBatch = 0; // StaticBatch id + 1, draws the whole batch (instance is ignored)
 
 	void setMaterial(u32 nameHash);
+	// model = translate(pos) * rotate(angle) * translate(-origin) * scale(size)
+	void setTransform(const lsk_Vec2& pos, const lsk_Vec2& size, f32 angle = 0.f,
+					  const lsk_Vec2& origin = {0, 0});
+};
+
+// commands queued between a beginFrame() and an endFrame()
+struct DrawFrame
+{
+	lsk_DArray<DrawCommand> lists[RENDERER_DRAW_LISTS]; // by JobPool thread id
+	lsk_DArray<u32> order; // draw ids (list << RENDERER_DRAW_ID_BITS | index), sorted by key
+
+	inline const DrawCommand& get(u32 drawId) const {
+		return lists[drawId >> RENDERER_DRAW_ID_BITS][drawId & ((1 << RENDERER_DRAW_ID_BITS) - 1)];
+	}
+};
+
+struct DrawGroup
+{
+	u32 vao;
+	MaterialType materialType;
+	u32 count;
+	u32 staticBatch; // StaticBatch id + 1, 0: count instances from the packet
+	u32 materialPage; // RENDERER_MATERIAL_MAX materials of its type, instance matIDs are relative to it
+};
+
+// instances and their own textured materials, uploaded once, drawn with one instanced draw
+struct StaticBatch
+{
+	lsk_DArray<Instance2D> instances; // matID indexes materials
+	lsk_DArray<Shader_Textured::Material> materials; // texture name hashes until uploaded
+	lsk_Vec2 boundsMin;
+	lsk_Vec2 boundsMax;
+	GLuint instanceBuff = 0;
+	GLuint materialBuff = 0;
+};
+
+// everything render() needs from one simulation tick, no pointer into simulation data
+struct FramePacket
+{
+	u64 tick = 0;
+	lsk_Mat4 orthoMatrix;
+	lsk_Vec2 viewPos;
+	lsk_Vec2 viewSize;
+	lsk_DArray<Instance2D> instances; // draw order
+	lsk_DArray<DrawGroup> groups;
+	lsk_DArray<Shader_Color::Material> flatData; // pages of RENDERER_MATERIAL_MAX, see DrawGroup
+	lsk_DArray<Shader_Textured::Material> texturedData; // texture name hashes until render() uploads them
+	lsk_DArray<lsk_Vec2> interpPos; // by instance
+	lsk_DArray<u64> interpKeys; // interpId << 32 | instance index, sorted
+
+	void init();
+	void destroy();
+	void clear();
+};
+
+enum class RendererBackend: i32 {
+	OPENGL,
+	NONE, // no GL call, render() only interpolates: headless runs and tests
 };
 
+/**
+ * Renderer
+ * - queue() appends to the calling thread's list of the current frame: no lock, threads don't share lists
+ * - frames are double buffered: endFrame() flips the frame queue() writes to, then sorts the finished
+ *   one into a FramePacket and publishes it
+ * - lists are merged in thread id order, same thread count same draw order
+ * - render() only reads packets and owns every GL call past init(), it can run on another thread
+ *   (the one holding the GL context)
+ * - render(alpha) draws between the two latest packets: interpId positions and view are lerped
+ * - static batches are uploaded by render() once, a queueStatic() is one draw, culled against the view
+ */
 struct RendererSingle
 {
 	SINGLETON_IMP(RendererSingle)
@@ -121,8 +224,11 @@ struct RendererSingle
 	// since it varies a lot from game to game
 	lsk_IAllocator* _pAlloc = &AllocDefault;
 
+	RendererBackend _backend = RendererBackend::OPENGL;
+
 	lsk_Mat4 _orthoMatrix;
-	lsk_Mat4 _viewPosMatrix;
+	lsk_Vec2 _viewPos = {0, 0};
+	lsk_Vec2 _viewSize = {0, 0};
 
 	GLuint _quadVao;
 	GLuint _quadVertexBuff;
@@ -133,34 +239,57 @@ struct RendererSingle
 	u64 _flat_materialBuffSize = 0;
 	u64 _textured_materialBuffSize = 0;
 
-	GLuint _materialIDBuffText;
-	u32 _materialIDBuffTextSlot = 0;
-	GLuint _materialIDBuff;
-	u64 _materialIDBuffSize = 0;
-
 	MaterialManager materials;
 
 	Shader_Color _materialType_color;
 	Shader_Textured _materialType_textured;
 
-	lsk_DArray<DrawCommand> _drawCmdList = lsk_DArray<DrawCommand>(2048);
-	lsk_DArray<u32> _drawCmdGroupCount = lsk_DArray<u32>(1024);
+	DrawFrame _frames[2];
+	std::atomic<u32> _writeFrame{0}; // frame queue() appends to
+
+	FramePacket _packets[RENDERER_PACKETS];
+	std::mutex _packetMutex; // guards the 4 packet ids below
+	i32 _packetLatest = -1; // published by endFrame()
+	i32 _packetPrev = -1;
+	i32 _renderCur = -1; // held by render() until its next call
+	i32 _renderPrev = -1;
+	u64 _tick = 0;
+
+	// by material id: its index in the packet material data, valid when fillId matches
+	struct PacketMaterialSlot {
+		u32 fillId;
+		u32 index;
+	};
+	lsk_DArray<PacketMaterialSlot> _packetMatSlots; // endFrame() only
+	u32 _packetFillId = 0;
+
+	lsk_DArray<Instance2D> _renderInstances; // interpolated, render thread only
+	u64 _gpuTick = 0; // packet the material buffers hold
 
-	GLuint _gpuModelMatrixBuff;
-	i32 _gpuModelMatrixBuffSize = -1;
+	StaticBatch _staticBatches[RENDERER_STATIC_BATCH_MAX];
+	std::atomic<u32> _staticBatchCount{0}; // created, a batch is immutable once counted
+	u32 _staticBatchUploaded = 0; // render thread only
 
-	// TODO: use two lists: one in-between begin/endFrame and one final to be rendered
-	// instead of locking one list
-	lsk_Mutex _listMutex;
+	GLuint _gpuInstanceBuff;
+	i32 _gpuInstanceBuffSize = -1;
 
 	enum Layout: u32 {
 		POSITION = 0,
 		TEXTURE_COORDINATES = 1,
-		MODEL = 2, // model is mat4 and thus takes 4 slots
+		INSTANCE_POS = 2,
+		INSTANCE_SIZE = 3,
+		INSTANCE_ANGLE = 4,
+		INSTANCE_MATID = 5,
 		NEXT = 6
 	};
 
-	bool init();
+	// uniform block binding points
+	enum BlockPoint: u32 {
+		COLOR_MATERIALS = 0,
+		TEXTURED_MATERIALS = 1
+	};
+
+	bool init(RendererBackend backend = RendererBackend::OPENGL);
 	void destroy();
 
 	void viewResize(i32 width, i32 height, f32 zoom = 1.f);
@@ -171,7 +300,24 @@ struct RendererSingle
 	void queue(const DrawCommand& cmd);
 	void queueSprite(u32 materialNameHash, i32 z, const lsk_Vec2& pos,
 					 const lsk_Vec2& size, const lsk_Quat& rot = lsk_Quat());
-	void render();
+	// from the simulation thread, copies both arrays, returns the batch id
+	u32 createStaticBatch(const Instance2D* instances, u32 instanceCount,
+						  const Shader_Textured::Material* materials, u32 materialCount);
+	void queueStatic(u32 batchId, i32 z);
+	// alpha: time since the latest tick, in ticks [0, 1]
+	void render(f32 alpha = 1.f);
+
+	bool _initGpu();
+	void _fillPacket(DrawFrame& frame, FramePacket& packet);
+	i32 _acquirePacket();
+	void _publishPacket(i32 packetId);
+	lsk_Vec2 _interpolate(const FramePacket& cur, const FramePacket* pPrev, f32 alpha);
+	void _upload(FramePacket& packet);
+	void _uploadStatic(StaticBatch& batch);
+	void _bindMaterialPage(MaterialType type, u32 page);
+	void _useMaterialType(MaterialType type, const lsk_Mat4& viewMat);
+	// Instance2D attributes from the bound GL_ARRAY_BUFFER, starting at baseOffset bytes
+	void _setInstanceAttribs(u64 baseOffset);
 };
 
 #define Renderer RendererSingle::get()
@@ -0,0 +1,94 @@
+#include "scheduler.h"
+#include "jobs.h"
+#include <lsk/lsk_utils.h>
+
+void SystemScheduler::add(const char* name, SystemFunc func, void* pUserData, SystemAccess reads,
+						  SystemAccess writes, u32 flags)
+{
+	assert_msg(_systemCount < SYSTEMS_MAX, "Too many systems, increase SYSTEMS_MAX");
+	System& system = _systems[_systemCount++];
+	system.name = name;
+	system.func = func;
+	system.pUserData = pUserData;
+	system.reads = reads;
+	system.writes = writes;
+	system.flags = flags;
+}
+
+void SystemScheduler::clear()
+{
+	_systemCount = 0;
+	_waveCount = 0;
+}
+
+static inline bool systemsConflict(const System& a, const System& b)
+{
+	if((a.flags | b.flags) & SYSTEM_USES_JOBS) {
+		return true;
+	}
+	return (a.writes & (b.reads | b.writes)) || (a.reads & b.writes);
+}
+
+void SystemScheduler::_buildWaves()
+{
+	// systems only depend on earlier ones: add order is a topological order
+	i32 wave[SYSTEMS_MAX];
+	_waveCount = 0;
+	for(i32 s = 0; s < _systemCount; ++s) {
+		wave[s] = 0;
+		for(i32 d = 0; d < s; ++d) {
+			if(wave[d] >= wave[s] && systemsConflict(_systems[d], _systems[s])) {
+				wave[s] = wave[d] + 1;
+			}
+		}
+		_waveCount = lsk_max(_waveCount, wave[s] + 1);
+	}
+
+	// counting sort, stable: add order within a wave
+	for(i32 w = 0; w <= _waveCount; ++w) {
+		_waveStart[w] = 0;
+	}
+	for(i32 s = 0; s < _systemCount; ++s) {
+		++_waveStart[wave[s] + 1];
+	}
+	for(i32 w = 0; w < _waveCount; ++w) {
+		_waveStart[w + 1] += _waveStart[w];
+	}
+	i32 cursor[SYSTEMS_MAX];
+	for(i32 w = 0; w < _waveCount; ++w) {
+		cursor[w] = _waveStart[w];
+	}
+	for(i32 s = 0; s < _systemCount; ++s) {
+		_order[cursor[wave[s]]++] = s;
+	}
+}
+
+static void systemsJob(void* pUserData, u32 begin, u32 end, u32)
+{
+	SystemScheduler& sched = *(SystemScheduler*)pUserData;
+	const i32 waveStart = sched._waveStart[sched._curWave];
+	for(u32 i = begin; i < end; ++i) {
+		const System& system = sched._systems[sched._order[waveStart + i]];
+		system.func(system.pUserData, sched._delta);
+	}
+}
+
+void SystemScheduler::run(f64 delta)
+{
+	_buildWaves();
+	_delta = delta;
+
+	for(_curWave = 0; _curWave < _waveCount; ++_curWave) {
+		const i32 count = _waveStart[_curWave + 1] - _waveStart[_curWave];
+		// alone in its wave: called from here, free to use the JobPool
+		if(count == 1) {
+			const System& system = _systems[_order[_waveStart[_curWave]]];
+			system.func(system.pUserData, delta);
+			continue;
+		}
+		const u32 nestedCount = Jobs._nestedCount.load(std::memory_order_relaxed);
+		Jobs.parallelFor(count, 1, systemsJob, this);
+		assert_msg(Jobs._nestedCount.load(std::memory_order_relaxed) == nestedCount,
+				   "A system sharing its wave called Jobs.parallelFor(), flag it SYSTEM_USES_JOBS");
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <lsk/lsk_types.h>
+
+#define SYSTEMS_MAX 64
+#define SYSTEM_ACCESS_ALL 0xffffffffffffffffull // unknown or global side effects
+
+// one bit per component type or shared resource, defined by the game
+typedef u64 SystemAccess;
+
+typedef void (*SystemFunc)(void* pUserData, f64 delta);
+
+enum: u32 {
+	SYSTEM_USES_JOBS = 1 << 0, // calls Jobs.parallelFor() itself, runs alone to get every thread
+};
+
+struct System
+{
+	const char* name;
+	SystemFunc func;
+	void* pUserData;
+	SystemAccess reads;
+	SystemAccess writes;
+	u32 flags;
+};
+
+/**
+ * Runs systems on the JobPool, ordered by the data they declare
+ * - a system depends on every system added before it that writes what it reads or writes,
+ *   or reads what it writes
+ * - each run() the dependency graph is split in waves (longest path to the system),
+ *   systems of a wave run in parallel, waves run in sequence
+ * - systems of a wave touch disjoint data: results are the same as running them in add order
+ */
+struct SystemScheduler
+{
+	SINGLETON_IMP(SystemScheduler)
+
+	System _systems[SYSTEMS_MAX];
+	i32 _systemCount = 0;
+	i32 _order[SYSTEMS_MAX]; // by wave, then add order
+	i32 _waveStart[SYSTEMS_MAX + 1];
+	i32 _waveCount = 0;
+	i32 _curWave = 0;
+	f64 _delta = 0;
+
+	void add(const char* name, SystemFunc func, void* pUserData, SystemAccess reads, SystemAccess writes,
+			 u32 flags = 0);
+	void clear();
+
+	void run(f64 delta);
+
+	void _buildWaves();
+};
+
+#define Systems SystemScheduler::get()
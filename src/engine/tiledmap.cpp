@@ -119,6 +119,19 @@ bool TiledMap::load(const char* buff, bool verbose)
 		tileset.height = (i32)json_object_get_number(item, "imageheight");
 		tileset.tileWidth = (i32)json_object_get_number(item, "tilewidth");
 		tileset.tileHeight = (i32)json_object_get_number(item, "tileheight");
+
+		// "tileproperties": { "<local id>": { "one_way": true } }
+		JSON_Object* tileProps = json_object_get_object(item, "tileproperties");
+		if(tileProps) {
+			const i32 propCount = json_object_get_count(tileProps);
+			for(i32 p = 0; p < propCount; ++p) {
+				const char* localId = json_object_get_name(tileProps, p);
+				JSON_Object* props = json_object_get_object(tileProps, localId);
+				if(json_object_get_boolean(props, "one_way") == 1) {
+					oneWayTiles.push(tileset.firstGid + atoi(localId));
+				}
+			}
+		}
 		if(verbose) lsk_printf("tileset %s { firstGid=%d, tileWidth=%d, tileHeight=%d}",
 				   tileset.imageName.c_str(), tileset.firstGid,
 				   tileset.tileWidth, tileset.tileHeight);
@@ -142,6 +155,71 @@ bool TiledMap::load(const char* buff, bool verbose)
 	return true;
 }
 
+bool TiledMap::isTileOneWay(i32 gid) const
+{
+	for(i32 t: oneWayTiles) {
+		if(t == gid) return true;
+	}
+	return false;
+}
+
+void TiledMap::bakeCollision(const LayerTile& layer, lsk_DArray<CollisionRect>* out, bool emitOneWay) const
+{
+	const i32 w = layer.width;
+	const i32 h = layer.height;
+
+	// 0: empty or already merged, 1: solid, 2: one-way
+	lsk_Block kindBlock = AllocDefault.allocate(w * h);
+	assert_msg(kindBlock.ptr, "Out of memory");
+	u8* kind = (u8*)kindBlock.ptr;
+
+	for(i32 i = 0; i < w * h; ++i) {
+		const i32 gid = layer.data[i];
+		kind[i] = 0;
+		if(gid != 0) {
+			kind[i] = (emitOneWay && isTileOneWay(gid)) ? 2 : 1;
+		}
+	}
+
+	for(i32 y = 0; y < h; ++y) {
+		for(i32 x = 0; x < w; ++x) {
+			const u8 k = kind[y * w + x];
+			if(!k) continue;
+
+			i32 runW = 1;
+			while(x + runW < w && kind[y * w + x + runW] == k) {
+				++runW;
+			}
+
+			// one-way platforms only collide on their top edge, keep them one tile tall
+			i32 runH = 1;
+			while(k == 1 && y + runH < h) {
+				const u8* row = kind + (y + runH) * w + x;
+				i32 i = 0;
+				while(i < runW && row[i] == k) {
+					++i;
+				}
+				if(i < runW) break;
+				++runH;
+			}
+
+			for(i32 ry = y; ry < y + runH; ++ry) {
+				memset(kind + ry * w + x, 0, runW);
+			}
+
+			CollisionRect rect;
+			rect.x = x;
+			rect.y = y;
+			rect.width = runW;
+			rect.height = runH;
+			rect.oneWay = k == 2;
+			out->push(rect);
+		}
+	}
+
+	AllocDefault.deallocate(kindBlock);
+}
+
 void TiledMap::initForDrawing()
 {
 	u64 tilesetMaterialDataSize = 0;
@@ -177,31 +255,89 @@ void TiledMap::initForDrawing()
 			}
 		}
 	}
+
+	// per chunk material set, gid -> chunk material index
+	const i32 gidCount = tilesetMaterialDataSize / sizeof(Shader_Textured::Material);
+	const Shader_Textured::Material* tileMatData = (Shader_Textured::Material*)tilesetMaterialMemBlock.ptr;
+	lsk_DArray<i32> chunkMatIds(gidCount);
+	for(i32 g = 0; g < gidCount; ++g) {
+		chunkMatIds.push(-1);
+	}
+	lsk_DArray<i32> chunkGids(64);
+	lsk_DArray<Shader_Textured::Material> chunkMaterials(64);
+	lsk_DArray<Instance2D> chunkInstances(TILEDMAP_CHUNK_SIZE * TILEDMAP_CHUNK_SIZE);
+
+	// a chunk can use more gids than a batch holds materials, it then spans several batches
+	auto flushChunk_func = [&]() {
+		if(chunkInstances.count() > 0) {
+			chunkBatches.push(Renderer.createStaticBatch(chunkInstances.data(), chunkInstances.count(),
+														 chunkMaterials.data(), chunkMaterials.count()));
+		}
+
+		for(i32 gid: chunkGids) {
+			chunkMatIds[gid] = -1;
+		}
+		chunkGids.clear();
+		chunkMaterials.clear();
+		chunkInstances.clear();
+	};
+
+	chunkBatches.clear();
+	for(auto& layer: tileLayers) {
+		layer.chunkStart = chunkBatches.count();
+
+		for(i32 cy = 0; cy < layer.height; cy += TILEDMAP_CHUNK_SIZE) {
+			for(i32 cx = 0; cx < layer.width; cx += TILEDMAP_CHUNK_SIZE) {
+				const i32 endY = lsk_min(cy + TILEDMAP_CHUNK_SIZE, layer.height);
+				const i32 endX = lsk_min(cx + TILEDMAP_CHUNK_SIZE, layer.width);
+
+				for(i32 y = cy; y < endY; ++y) {
+					for(i32 x = cx; x < endX; ++x) {
+						i32 gid = layer.data[y * layer.width + x] - 1;
+						if(gid < 0) continue;
+						assert(gid < gidCount);
+
+						if(chunkMatIds[gid] == -1) {
+							if(chunkMaterials.count() == RENDERER_MATERIAL_MAX) {
+								flushChunk_func();
+							}
+							chunkMatIds[gid] = chunkMaterials.count();
+							chunkMaterials.push(tileMatData[gid]);
+							chunkGids.push(gid);
+						}
+
+						// FIXME: some tiles dont have the same dimensions
+						Instance2D inst;
+						inst.pos[0] = (f32)x * tileWidth;
+						inst.pos[1] = (f32)y * tileHeight;
+						inst.size[0] = (f32)tileWidth;
+						inst.size[1] = (f32)tileHeight;
+						inst.matID = chunkMatIds[gid];
+						chunkInstances.push(inst);
+					}
+				}
+
+				flushChunk_func();
+			}
+		}
+
+		layer.chunkCount = chunkBatches.count() - layer.chunkStart;
+	}
+
+	chunkMatIds.destroy();
+	chunkGids.destroy();
+	chunkMaterials.destroy();
+	chunkInstances.destroy();
 }
 
 void TiledMap::draw()
 {
-	Shader_Textured::Material* matData = (Shader_Textured::Material*)tilesetMaterialMemBlock.ptr;
-
 	i32 z = 0;
 	for(const auto& layer: tileLayers) {
 		if(!layer.visible) continue;
 
-		for(i32 y = 0; y < layer.height; ++y) {
-			for(i32 x = 0; x < layer.width; ++x) {
-				i32 gid = layer.data[y * layer.width + x] - 1;
-				if(gid < 0) continue;
-
-				DrawCommand cmd;
-				// FIXME: some tiles dont have the same dimensions
-				cmd.modelMatrix = lsk_Mat4Translate({(f32)x * tileWidth, (f32)y * tileHeight, 0}) *
-						lsk_Mat4Scale({(f32)tileWidth, (f32)tileHeight, 0});
-				cmd.vao = Renderer._quadVao;
-				cmd.z = z;
-				cmd._materialType = MaterialType::TEXTURED;
-				cmd._pMaterialData = matData + gid;
-				Renderer.queue(cmd);
-			}
+		for(u32 c = 0; c < layer.chunkCount; ++c) {
+			Renderer.queueStatic(chunkBatches[layer.chunkStart + c], z);
 		}
 
 		z += 10;
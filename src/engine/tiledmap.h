@@ -1,6 +1,8 @@
 #pragma once
 #include <lsk/lsk_array.h>
 
+#define TILEDMAP_CHUNK_SIZE 32 // in tiles, a chunk of a layer is one static draw
+
 struct LayerTile
 {
 	i32 visible = 1;
@@ -8,6 +10,7 @@ struct LayerTile
 	i32* data = nullptr;
 	lsk_DStr64 name;
 	lsk_Block dataBlock = NULL_BLOCK;
+	u32 chunkStart = 0, chunkCount = 0; // in TiledMap::chunkBatches
 
 	~LayerTile();
 };
@@ -34,6 +37,14 @@ struct Tileset
 	i32 tileWidth = 0, tileHeight = 0;
 };
 
+// merged block of tiles, in tiles
+struct CollisionRect
+{
+	i32 x, y;
+	i32 width, height;
+	i32 oneWay;
+};
+
 struct TiledMap
 {
 	~TiledMap();
@@ -44,12 +55,25 @@ struct TiledMap
 	lsk_DArray<LayerTile> tileLayers = lsk_DArray<LayerTile>(1);
 	lsk_DArray<LayerObject> objectLayers = lsk_DArray<LayerObject>(1);
 	lsk_DArray<Tileset> tilesets = lsk_DArray<Tileset>(1);
+	lsk_DArray<i32> oneWayTiles = lsk_DArray<i32>(1); // gids with the "one_way" tile property
 
 	lsk_Block tilesetMaterialMemBlock = NULL_BLOCK;
 	lsk_AllocatorStack tilesetMaterialStack;
+	lsk_DArray<u32> chunkBatches = lsk_DArray<u32>(1); // Renderer static batch ids, by layer
 
 	bool load(const char* buff, bool verbose = false);
 
+	bool isTileOneWay(i32 gid) const;
+	/**
+	 * Greedy 2D merge of non-empty tiles into maximal rectangles
+	 * - rows are extended first, then the run is grown downwards while the whole run is free
+	 * - one-way tiles are merged separately (rows only) when emitOneWay is set,
+	 *   otherwise they are solid like any other tile
+	 */
+	void bakeCollision(const LayerTile& layer, lsk_DArray<CollisionRect>* out, bool emitOneWay = true) const;
+
+	// bakes the tile layers into static batches, empty chunks are skipped
 	void initForDrawing();
+	// one Renderer.queueStatic() per chunk of every visible layer
 	void draw();
 };
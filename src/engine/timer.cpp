@@ -0,0 +1,201 @@
+#include "timer.h"
+
+void TimerManager::init()
+{
+	_chunks.init(8);
+	++allocCount;
+	_freeHead = -1;
+	_time = 0;
+	_tick = 0;
+	for(i32 l = 0; l < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; ++l) {
+		_listHead[l] = -1;
+		_listTail[l] = -1;
+	}
+}
+
+void TimerManager::destroy()
+{
+	reset();
+	// timers are trivially destructible
+	for(auto& block: _chunks) {
+		AllocDefault.deallocate(block);
+	}
+	_chunks.destroy();
+}
+
+void TimerManager::reset()
+{
+	for(i32 l = 0; l < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; ++l) {
+		while(_listHead[l] != -1) {
+			const i32 id = _listHead[l];
+			_unlink(id);
+			_freeTimer(id);
+		}
+	}
+	_time = 0;
+	_tick = 0;
+}
+
+i32 TimerManager::_allocTimer()
+{
+	if(_freeHead == -1) {
+		// new chunk, threaded onto the free list
+		lsk_Block block = AllocDefault.allocate(sizeof(Timer) * TIMER_CHUNK_SIZE, alignof(Timer));
+		assert_msg(block.ptr, "Out of memory");
+		++allocCount;
+		if(_chunks.count() == _chunks._capacity) {
+			++allocCount; // chunk list grows
+		}
+		Timer* pChunk = (Timer*)block.ptr;
+		const i32 base = _chunks.count() * TIMER_CHUNK_SIZE;
+		for(i32 i = 0; i < TIMER_CHUNK_SIZE; ++i) {
+			new(pChunk + i) Timer();
+			pChunk[i].next = i + 1 < TIMER_CHUNK_SIZE ? base + i + 1 : -1;
+		}
+		_chunks.push(block);
+		_freeHead = base;
+	}
+
+	const i32 id = _freeHead;
+	_freeHead = _get(id).next;
+	return id;
+}
+
+void TimerManager::_freeTimer(i32 id)
+{
+	Timer& timer = _get(id);
+	timer.f = nullptr;
+	++timer.generation;
+	timer.next = _freeHead;
+	_freeHead = id;
+}
+
+void TimerManager::_link(i32 id)
+{
+	Timer& timer = _get(id);
+	const u64 delta = timer.expireTick > _tick ? timer.expireTick - _tick : 0;
+
+	i32 level = 0;
+	while(level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1)))) {
+		++level;
+	}
+
+	u64 slot;
+	if(delta >= (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))) {
+		// out of range: the last slot before the top level wraps, relinked when cascaded
+		slot = (_tick >> (TIMER_WHEEL_BITS * level)) - 1;
+	}
+	else if(delta == 0) {
+		slot = _tick; // cascaded on its expiry tick, fires right after the cascade
+	}
+	else {
+		slot = timer.expireTick >> (TIMER_WHEEL_BITS * level);
+	}
+
+	const i32 list = level * TIMER_WHEEL_SLOTS + (i32)(slot & (TIMER_WHEEL_SLOTS - 1));
+	timer.list = list;
+	timer.prev = _listTail[list];
+	timer.next = -1;
+	if(_listTail[list] != -1) {
+		_get(_listTail[list]).next = id;
+	}
+	else {
+		_listHead[list] = id;
+	}
+	_listTail[list] = id;
+}
+
+void TimerManager::_unlink(i32 id)
+{
+	Timer& timer = _get(id);
+	if(timer.prev != -1) {
+		_get(timer.prev).next = timer.next;
+	}
+	else {
+		_listHead[timer.list] = timer.next;
+	}
+	if(timer.next != -1) {
+		_get(timer.next).prev = timer.prev;
+	}
+	else {
+		_listTail[timer.list] = timer.prev;
+	}
+	timer.list = -1;
+	timer.prev = -1;
+	timer.next = -1;
+}
+
+void TimerManager::_cascade(i32 level)
+{
+	// relink the current slot of this level, its timers land in finer levels
+	const i32 list = level * TIMER_WHEEL_SLOTS +
+					 (i32)((_tick >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+	i32 id = _listHead[list];
+	_listHead[list] = -1;
+	_listTail[list] = -1;
+	while(id != -1) {
+		const i32 next = _get(id).next;
+		_link(id);
+		id = next;
+	}
+}
+
+void TimerManager::update(f64 delta)
+{
+	_time += delta;
+
+	// re-evaluated every tick, a callback may reset()
+	while(_tick < (u64)(_time * TIMER_TICKS_PER_SEC)) {
+		++_tick;
+
+		// coarse levels first, a timer can move down several levels on the same tick
+		for(i32 level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+			if((_tick & ((1ull << (TIMER_WHEEL_BITS * level)) - 1)) == 0) {
+				_cascade(level);
+			}
+		}
+
+		// popped one by one, callbacks may add or cancel timers
+		const i32 list = (i32)(_tick & (TIMER_WHEEL_SLOTS - 1));
+		while(_listHead[list] != -1) {
+			const i32 id = _listHead[list];
+			_unlink(id);
+			TimerFunction f = _get(id).f;
+			_freeTimer(id);
+			f();
+		}
+	}
+}
+
+TimerHandle TimerManager::add(f64 delay, const TimerFunction& f)
+{
+	const i32 id = _allocTimer();
+	Timer& timer = _get(id);
+	timer.f = f;
+	// fires on the first update reaching it, never on the current tick
+	const u64 delayTicks = delay > 0.0 ? (u64)(delay * TIMER_TICKS_PER_SEC + 0.5) : 0;
+	timer.expireTick = _tick + lsk_max(delayTicks, (u64)1);
+	_link(id);
+
+	TimerHandle handle;
+	handle._id = (u32)id;
+	handle._generation = timer.generation;
+	return handle;
+}
+
+bool TimerManager::cancel(TimerHandle handle)
+{
+	if(handle._id >= (u32)_chunks.count() * TIMER_CHUNK_SIZE) {
+		return false;
+	}
+
+	const i32 id = (i32)handle._id;
+	Timer& timer = _get(id);
+	if(timer.generation != handle._generation || timer.list == -1) {
+		return false;
+	}
+
+	_unlink(id);
+	_freeTimer(id);
+	return true;
+}
@@ -1,45 +1,114 @@
 #pragma once
-#include <functional>
+#include <new>
+#include <type_traits>
 #include <lsk/lsk_array.h>
 
-typedef std::function<void()> TimerFunction;
+#define TIMER_TICKS_PER_SEC 1000.0 // 1ms ticks
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4 // 2^24 ticks (4.6h), longer timers wait in the last level
+#define TIMER_CHUNK_SIZE 256 // timers per pool chunk
+#define TIMER_FUNC_CAPACITY 32 // bytes of captures stored in place
+#define TIMER_FUNC_ALIGN 16
 
+/**
+ * Inline callable for timers
+ * - captures are stored in place, never allocates
+ * - called through a plain function pointer, no virtual call
+ * - captures must fit TIMER_FUNC_CAPACITY and be trivially copyable (copied and dropped as
+ *   raw bytes), both are checked at compile time: capture pointers or references instead
+ */
+struct alignas(TIMER_FUNC_ALIGN) TimerFunction
+{
+	u8 _storage[TIMER_FUNC_CAPACITY];
+	void (*_call)(void*) = nullptr;
+
+	TimerFunction() = default;
+
+	TimerFunction(decltype(nullptr)) {}
+
+	template<typename F, typename = typename std::enable_if<
+				 !std::is_same<typename std::decay<F>::type, TimerFunction>::value>::type>
+	TimerFunction(const F& f) {
+		static_assert(sizeof(F) <= TIMER_FUNC_CAPACITY, "Timer callback captures too much, capture by reference");
+		static_assert(alignof(F) <= TIMER_FUNC_ALIGN, "Timer callback captures are over-aligned");
+		static_assert(std::is_trivially_copyable<F>::value, "Timer callback captures must be trivially copyable");
+		new(_storage) F(f);
+		_call = [](void* pStorage) {
+			(*(F*)pStorage)();
+		};
+	}
+
+	inline void operator()() {
+		assert(_call);
+		_call(_storage);
+	}
+
+	inline explicit operator bool() const {
+		return _call != nullptr;
+	}
+};
+
+// stale once the timer fired or was cancelled, the generation no longer matches
+struct TimerHandle
+{
+	u32 _id = 0xffffffff;
+	u32 _generation = 0;
+};
+
+/**
+ * Hierarchical timing wheel
+ * - level 0 has one slot per tick, each level above is TIMER_WHEEL_SLOTS times coarser
+ * - add() and cancel() are O(1), a timer moves down at most once per level before firing
+ * - timers live in a chunked pool: stable addresses, no cap, freed timers are reused
+ * - timers fire in expiry tick order, then insertion order
+ * - allocCount only grows with a new pool chunk, scheduling in steady state never allocates
+ */
 struct TimerManager
 {
 	SINGLETON_IMP(TimerManager)
 
 	struct Timer {
 		TimerFunction f;
-		f64 delay;
+		u64 expireTick = 0;
+		i32 prev = -1;
+		i32 next = -1; // next free timer when not linked
+		i32 list = -1; // level * TIMER_WHEEL_SLOTS + slot
+		u32 generation = 0;
 	};
 
 	f64 _time = 0;
-	lsk_Array<Timer, 1024> _timers;
+	u64 _tick = 0;
+	lsk_DArray<lsk_Block> _chunks; // TIMER_CHUNK_SIZE timers each
+	i32 _freeHead = -1;
+	u32 allocCount = 0; // allocator calls made by the timer pool
+	i32 _listHead[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+	i32 _listTail[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
 
-	void reset() {
-		_timers.clear();
-		_time = 0;
-	}
+	void init();
+	void destroy();
+	// cancels every timer
+	void reset();
 
-	void udpate(f64 delta) {
-		_time += delta;
-		for(i32 i = 0; i < _timers.count(); ++i) {
-			_timers[i].delay -= delta;
-			if(_timers[i].delay <= 0.0) {
-				_timers[i].f();
-				_timers.remove(_timers[i]);
-				--i;
-			}
-		}
-	}
+	void update(f64 delta);
 
-	inline void add(f64 delay, TimerFunction f) {
-		_timers.push({f, delay});
-	}
+	TimerHandle add(f64 delay, const TimerFunction& f);
+	// returns false when the timer already fired or was cancelled
+	bool cancel(TimerHandle handle);
 
 	inline f64 getTime() const {
 		return _time;
 	}
+
+	inline Timer& _get(i32 id) {
+		return ((Timer*)_chunks[id / TIMER_CHUNK_SIZE].ptr)[id % TIMER_CHUNK_SIZE];
+	}
+
+	i32 _allocTimer();
+	void _freeTimer(i32 id);
+	void _link(i32 id);
+	void _unlink(i32 id);
+	void _cascade(i32 level);
 };
 
 #define Timers TimerManager::get()
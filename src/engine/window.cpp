@@ -1,16 +1,20 @@
 #include "window.h"
+#include <lsk/lsk_thread.h>
 #include "renderer.h"
 #include "texture.h"
 #include "audio.h"
 #include "timer.h"
+#include "jobs.h"
 
 bool IGameWindow::init(const GameWindowConfig& config)
 {
 	_config = config;
 	_running = true;
-	_lastFrameBeginTp = timeNow();
+	_startTp = timeNow();
+	_lastFrameBeginTp = _startTp;
 	_updateDt = 1.0 / config.updateFrequency;
 	_accumulator = 0;
+	_lastTickTime = 0;
 
 	if(config.maxFps > 0) {
 		_maxFrameTime = 1.0 / (f64)config.maxFps;
@@ -71,6 +75,8 @@ bool IGameWindow::init(const GameWindowConfig& config)
 	/*glGetIntegerv(GL_NV_MEMORY_DEDICATED, &_gpuMemTotal);
 	glGetIntegerv(GL_NV_MEMORY_AVAILABLE, &_gpuMemAvailStart);*/
 
+	Jobs.init();
+	Timers.init();
 	Textures.init();
 
 	if(!Renderer.init()) {
@@ -93,10 +99,18 @@ bool IGameWindow::init(const GameWindowConfig& config)
 
 void IGameWindow::exit()
 {
+	if(_renderThread.joinable()) {
+		_running = false;
+		_renderThread.join();
+		SDL_GL_MakeCurrent(_pWindow, _glContext); // GL objects are destroyed from here
+	}
+
 	preExit();
 	AudioGet.destroy();
 	Renderer.destroy();
 	Textures.destroy();
+	Timers.destroy();
+	Jobs.destroy();
 
 	if(_glContext) SDL_GL_DeleteContext(_glContext);
 	if(_pWindow) SDL_DestroyWindow(_pWindow);
@@ -131,12 +145,18 @@ bool IGameWindow::handleEvent(SDL_Event event)
 void IGameWindow::update(f64 delta)
 {
 	AudioGet.update();
-	Timers.udpate(delta);
+	Timers.update(delta);
 }
 
 void IGameWindow::render()
 {
-	Renderer.render();
+	Renderer.render(renderAlpha());
+}
+
+f32 IGameWindow::renderAlpha()
+{
+	const f64 sinceTick = timeDurSince(_startTp) - _lastTickTime.load();
+	return (f32)lsk_clamp(sinceTick / _updateDt, 0.0, 1.0);
 }
 
 void IGameWindow::run()
@@ -147,6 +167,12 @@ void IGameWindow::run()
 	}
 	defer(exit(););
 
+	if(_config.renderThread) {
+		// the context can only be current on one thread
+		SDL_GL_MakeCurrent(_pWindow, nullptr);
+		_renderThread = std::thread(&IGameWindow::_renderLoop, this);
+	}
+
 	SDL_Event event;
 	while(_running) {
 		while(SDL_PollEvent(&event)) {
@@ -156,7 +182,7 @@ void IGameWindow::run()
 		}
 
 		f64 elapsed = timeDurSince(_lastFrameBeginTp);
-		if(elapsed < _maxFrameTime) {
+		if(!_config.renderThread && elapsed < _maxFrameTime) {
 			lsk_sleep((_maxFrameTime - elapsed) * 1000);
 			elapsed = _maxFrameTime;
 		}
@@ -178,18 +204,53 @@ void IGameWindow::run()
 				Renderer.endFrame();
 			}
 		}
+		_lastTickTime = timeDurSince(_startTp) - _accumulator;
+
+		if(_config.renderThread) {
+			// nothing to do until the next tick
+			lsk_sleep((_updateDt - _accumulator) * 1000);
+			continue;
+		}
 
 		if(_windowActive) {
 			render();
 			SDL_GL_SwapWindow(_pWindow);
 		}
+		_countFps();
+	}
+}
+
+void IGameWindow::_renderLoop()
+{
+	SDL_GL_MakeCurrent(_pWindow, _glContext);
 
-		// simple fps check
-		++_fps;
-		if(timeDurSince(_fpsDisplayTp) > 1.f) {
-			lsk_printf("ft: %.5fms [%d]", 1000.f/_fps, _fps);
-			_fpsDisplayTp = timeNow();
-			_fps = 0;
+	while(_running) {
+		timept frameBeginTp = timeNow();
+		if(_windowActive) {
+			render();
+			SDL_GL_SwapWindow(_pWindow);
+		}
+		else {
+			lsk_sleep(_updateDt * 1000);
+		}
+
+		f64 elapsed = timeDurSince(frameBeginTp);
+		if(elapsed < _maxFrameTime) {
+			lsk_sleep((_maxFrameTime - elapsed) * 1000);
 		}
+		_countFps();
+	}
+
+	SDL_GL_MakeCurrent(_pWindow, nullptr);
+}
+
+void IGameWindow::_countFps()
+{
+	// simple fps check
+	++_fps;
+	if(timeDurSince(_fpsDisplayTp) > 1.f) {
+		lsk_printf("ft: %.5fms [%d]", 1000.f/_fps, _fps);
+		_fpsDisplayTp = timeNow();
+		_fps = 0;
 	}
 }
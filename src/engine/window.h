@@ -4,6 +4,8 @@
 #include <external/gl3w.h>
 #include <lsk/lsk_string.h>
 #include <lsk/lsk_utils.h>
+#include <atomic>
+#include <thread>
 
 struct GameWindowConfig
 {
@@ -17,20 +19,23 @@ struct GameWindowConfig
 	bool vsync = false;
 	i32 maxFps = -1;
 	f64 updateFrequency = 60.0;
+	bool renderThread = false; // render() and swaps on their own thread, which owns the GL context
 };
 
 struct IGameWindow
 {
 	GameWindowConfig _config;
-	bool _running = false;
-	bool _windowActive = true;
+	std::atomic<bool> _running{false};
+	std::atomic<bool> _windowActive{true};
 	SDL_Window* _pWindow = nullptr;
 	SDL_GLContext _glContext = nullptr;
-	timept _lastFrameBeginTp, _fpsDisplayTp;
+	timept _startTp, _lastFrameBeginTp, _fpsDisplayTp;
 	f64 _updateDt = 1;
 	f64 _accumulator = 0;
 	f64 _maxFrameTime = 0;
+	std::atomic<f64> _lastTickTime{0}; // since _startTp, time the latest tick stands for
 	i32 _fps = 0;
+	std::thread _renderThread;
 
 	virtual bool init(const GameWindowConfig& config);
 	virtual void exit();
@@ -39,6 +44,11 @@ struct IGameWindow
 	virtual void render();
 	virtual void run();
 
+	// _accumulator / _updateDt, grown by the time since on the render thread
+	f32 renderAlpha();
+	void _renderLoop();
+	void _countFps();
+
 	virtual bool postInit() { return true;}
 	virtual void preExit() {}
 };
@@ -3,7 +3,10 @@
 #include <lsk/lsk_console.h>
 #include <engine/timer.h>
 #include <engine/audio.h>
+#include <engine/archetype.h>
+#include <engine/scheduler.h>
 #include <time.h>
+#include <string.h>
 
 #define SKELETON_AGGRO_RANGE 220.f
 #define GLOBAL_VOLUME 0.5
@@ -20,17 +23,33 @@
 #define SKELETON_BIG_RUNNING_SIZEX 27
 #define SKELETON_BIG_ATTACK_SIZEX 33
 
-enum: i32 {
-	BODYGROUP_PLAYER = 0,
-	BODYGROUP_SKELETON,
-	BODYGROUP_BOSS,
+#define DAMAGE_CELL_SIZE 32.f
+#define DAMAGE_BIN_FIELD 0x80000000u
+
+enum: u32 {
+	LAYER_WORLD = PHYSICS_LAYER_DEFAULT,
+	LAYER_PLAYER = 1 << 1,
+	LAYER_SKELETON = 1 << 2,
+	LAYER_BOSS = 1 << 3,
+};
+
+// data the update systems read or write
+enum: SystemAccess {
+	ACCESS_BODIES = 1 << 0,
+	ACCESS_TRANSFORM = 1 << 1,
+	ACCESS_HEALTH = 1 << 2,
+	ACCESS_TARGET = 1 << 3,
+	ACCESS_DAMAGE = 1 << 4,
+	ACCESS_MATERIALS = 1 << 5,
+	ACCESS_RENDER_QUEUE = 1 << 6,
+	ACCESS_AUDIO = 1 << 7,
 };
 
 Actor::Actor()
 {
-	transform = Ord.make_Transform();
+	transform = Ord.make<Transform>();
 	transform->position.z = 1;
-	bodyComp = Ord.make_CBodyComponent();
+	bodyComp = Ord.make<CBodyComponent>();
 	bodyComp->transform = transform;
 }
 
@@ -42,26 +61,256 @@ void Actor::setPos(lsk_Vec2 pos)
 }
 
 
-void DamageFieldManager::init()
+void DamageFieldManager::init(f64 tickDt)
 {
-	fields.init(32);
+	_tickDt = tickDt;
+	_tick = 0;
+	for(i32 s = 0; s < DAMAGE_WHEEL_SLOTS; ++s) {
+		_wheel[s] = -1;
+	}
+
+	fields.init(256);
+	receivers.init(32);
+	hits.init(32);
+	_bins.init(128);
 }
 
 void DamageFieldManager::destroy()
 {
 	fields.destroy();
+	receivers.destroy();
+	hits.destroy();
+	_bins.destroy();
+}
+
+static inline u32 damageHitKey(u8 bodyType, u32 bodyId)
+{
+	return ((u32)bodyType << 24) | bodyId;
+}
+
+static inline i32 damageCellCoord(f32 v)
+{
+	return (i32)lsk_clamp(floorf(v / DAMAGE_CELL_SIZE), (f32)-I16_MAX, (f32)I16_MAX);
+}
+
+static inline u32 damageCellKey(i32 x, i32 y)
+{
+	return ((u32)(u16)x << 16) | (u16)y;
+}
+
+static i32 compareDamageBins(const void* a, const void* b)
+{
+	const DamageBin& ba = *(const DamageBin*)a;
+	const DamageBin& bb = *(const DamageBin*)b;
+	if(ba.cell != bb.cell) {
+		return ba.cell < bb.cell ? -1 : 1;
+	}
+	// receivers then fields
+	return ba.item < bb.item ? -1 : (ba.item > bb.item ? 1 : 0);
+}
+
+static i32 compareDamageHits(const void* a, const void* b)
+{
+	const DamageHit& ha = *(const DamageHit*)a;
+	const DamageHit& hb = *(const DamageHit*)b;
+	if(ha.bodyKey != hb.bodyKey) {
+		return ha.bodyKey < hb.bodyKey ? -1 : 1;
+	}
+	return (i32)ha.fieldId - (i32)hb.fieldId;
 }
 
-void DamageFieldManager::update(f64 delta)
+void DamageFieldManager::addReceiver(const Ref<BodyRectAligned>& body, u8 bodyType, const Ref<CHealth>& health)
 {
-	for(i32 i = 0; i < fields.count(); ++i) {
-		fields[i].lifetime -= delta;
-		if(fields[i].lifetime <= 0) {
-			fields.remove(i);
+	DamageReceiver rec;
+	rec.body = body;
+	rec.bodyKey = damageHitKey(bodyType, body._id);
+	rec.health = health;
+	receivers.push(rec);
+}
+
+void DamageFieldManager::removeReceiver(const Ref<BodyRectAligned>& body, u8 bodyType)
+{
+	const u32 key = damageHitKey(bodyType, body._id);
+	for(i32 i = 0; i < receivers.count(); ++i) {
+		if(receivers[i].bodyKey == key) {
+			receivers.remove(i);
+			return;
 		}
 	}
 }
 
+void DamageFieldManager::add(const DamageField& field, f64 lifetime)
+{
+	const u32 lifetimeTicks = lsk_max(1u, (u32)(lifetime / _tickDt + 0.5));
+
+	const i32 id = fields.count();
+	fields.push(field);
+	DamageField& f = fields[id];
+	f._expireTick = _tick + lifetimeTicks;
+
+	const u32 slot = f._expireTick & (DAMAGE_WHEEL_SLOTS - 1);
+	f._wheelPrev = -1;
+	f._wheelNext = _wheel[slot];
+	if(f._wheelNext != -1) {
+		fields[f._wheelNext]._wheelPrev = id;
+	}
+	_wheel[slot] = id;
+}
+
+void DamageFieldManager::_unlinkField(i32 id)
+{
+	const DamageField& f = fields[id];
+	if(f._wheelPrev != -1) {
+		fields[f._wheelPrev]._wheelNext = f._wheelNext;
+	}
+	else {
+		_wheel[f._expireTick & (DAMAGE_WHEEL_SLOTS - 1)] = f._wheelNext;
+	}
+	if(f._wheelNext != -1) {
+		fields[f._wheelNext]._wheelPrev = f._wheelPrev;
+	}
+}
+
+void DamageFieldManager::_removeField(i32 id)
+{
+	_unlinkField(id);
+
+	// the last field fills the hole, links pointing to it are patched in place
+	const i32 last = fields.count() - 1;
+	if(id != last) {
+		const DamageField& moved = fields[last];
+		if(moved._wheelPrev != -1) {
+			fields[moved._wheelPrev]._wheelNext = id;
+		}
+		else {
+			_wheel[moved._expireTick & (DAMAGE_WHEEL_SLOTS - 1)] = id;
+		}
+		if(moved._wheelNext != -1) {
+			fields[moved._wheelNext]._wheelPrev = id;
+		}
+	}
+	fields.remove(id);
+}
+
+void DamageFieldManager::_binBox(const lsk_AABB2& box, u32 item)
+{
+	const i32 minX = damageCellCoord(box.min.x);
+	const i32 minY = damageCellCoord(box.min.y);
+	const i32 maxX = damageCellCoord(box.max.x);
+	const i32 maxY = damageCellCoord(box.max.y);
+	for(i32 y = minY; y <= maxY; ++y) {
+		for(i32 x = minX; x <= maxX; ++x) {
+			_bins.push({damageCellKey(x, y), item});
+		}
+	}
+}
+
+void DamageFieldManager::update()
+{
+	_bins.clear();
+	const u32 fieldCount = fields.count();
+	for(u32 f = 0; f < fieldCount; ++f) {
+		_binBox(fields[f].box, f | DAMAGE_BIN_FIELD);
+	}
+	const u32 receiverCount = receivers.count();
+	for(u32 r = 0; r < receiverCount; ++r) {
+		_binBox(receivers[r].body.get().box, r);
+	}
+	qsort(_bins.data(), _bins.count(), sizeof(DamageBin), compareDamageBins);
+
+	hits.clear();
+	const DamageBin* bins = _bins.data();
+	const u32 binCount = _bins.count();
+	u32 b = 0;
+	while(b < binCount) {
+		const u32 cell = bins[b].cell;
+		u32 firstField = b;
+		while(firstField < binCount && bins[firstField].cell == cell &&
+			  !(bins[firstField].item & DAMAGE_BIN_FIELD)) {
+			++firstField;
+		}
+		u32 end = firstField;
+		while(end < binCount && bins[end].cell == cell) {
+			++end;
+		}
+
+		for(u32 r = b; r < firstField; ++r) {
+			const u32 receiverId = bins[r].item;
+			const lsk_AABB2& rbox = receivers[receiverId].body.get().box;
+			for(u32 f = firstField; f < end; ++f) {
+				const u32 fieldId = bins[f].item & ~DAMAGE_BIN_FIELD;
+				const lsk_AABB2& fbox = fields[fieldId].box;
+				if(!intersectTest(rbox, fbox, nullptr)) {
+					continue;
+				}
+				// pairs sharing several cells are only reported by the cell holding the overlap's min corner
+				const u32 cornerCell = damageCellKey(damageCellCoord(lsk_max(rbox.min.x, fbox.min.x)),
+													 damageCellCoord(lsk_max(rbox.min.y, fbox.min.y)));
+				if(cornerCell == cell) {
+					hits.push({receivers[receiverId].bodyKey, fieldId, receiverId, fields[fieldId].dmgGroup});
+				}
+			}
+		}
+		b = end;
+	}
+
+	qsort(hits.data(), hits.count(), sizeof(DamageHit), compareDamageHits);
+
+	for(const auto& hit: hits) {
+		DamageReceiver& rec = receivers[hit.receiverId];
+		if(!rec.health.valid()) {
+			continue;
+		}
+		CHealth& health = rec.health.get();
+		const DamageField& field = fields[hit.fieldId];
+		if(field.dmgGroup != health.dmgGroup) {
+			health.takeDamage(field);
+		}
+	}
+
+	// expire after resolving, fields created in-between updates get lifetimeTicks passes
+	++_tick;
+	i32 id = _wheel[_tick & (DAMAGE_WHEEL_SLOTS - 1)];
+	while(id != -1) {
+		i32 next = fields[id]._wheelNext;
+		if(fields[id]._expireTick <= _tick) {
+			const i32 last = fields.count() - 1;
+			_removeField(id);
+			if(next == last) {
+				next = id;
+			}
+		}
+		id = next;
+	}
+}
+
+u32 DamageFieldManager::findHits(u8 bodyType, u32 bodyId, const DamageHit** out_ppHits) const
+{
+	const u32 key = damageHitKey(bodyType, bodyId);
+	const DamageHit* data = hits.data();
+
+	// lower bound
+	u32 lo = 0;
+	u32 hi = hits.count();
+	while(lo < hi) {
+		u32 mid = (lo + hi) / 2;
+		if(data[mid].bodyKey < key) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	u32 end = lo;
+	while(end < hits.count() && data[end].bodyKey == key) {
+		++end;
+	}
+
+	*out_ppHits = data + lo;
+	return end - lo;
+}
+
 void damageFieldCreate(const lsk_Vec2& pos, const lsk_Vec2& size, DamageGroup dmgGroup,
 					   const lsk_Vec2& sourcePos)
 {
@@ -69,9 +318,11 @@ void damageFieldCreate(const lsk_Vec2& pos, const lsk_Vec2& size, DamageGroup dm
 	field.box.min = pos;
 	field.box.max = pos + size;
 	field.dmgGroup = dmgGroup;
-	field.lifetime = 0.1;
 	field.sourcePos = sourcePos;
-	DamageFieldManager::get().fields.push(field);
+	DamageFieldManager::get().add(field, 0.1);
+
+	// bodies hit must react to knockback
+	Physics.wakeInBox(field.box);
 }
 
 void CHealth::takeDamage(const DamageField& source)
@@ -93,20 +344,22 @@ void CHealth::takeDamage(const DamageField& source)
 
 void CHealth::update(f64 delta)
 {
+	// hits are sent by DamageFieldManager::update()
 	dmgCooldown -= delta;
+}
 
-	for(const auto& field: DamageFieldManager::get().fields) {
-		if(field.dmgGroup != dmgGroup && intersectTest(body->box, field.box, nullptr)) {
-			takeDamage(field);
-		}
+void CHealth::endPlay()
+{
+	if(body.valid()) {
+		DamageFieldManager::get().removeReceiver(body, BODYTYPE_DYNAMIC);
 	}
 }
 
 APlayer::APlayer()
 {
-	healthComp = Ord.make_CHealth();
+	healthComp = Ord.make<CHealth>();
 	healthComp->dmgGroup = DamageGroup::PLAYER;
-	sprite = Ord.make_Sprite();
+	sprite = Ord.make<Sprite>();
 	sprite->transform = transform;
 	sprite->materialName = H("explorer_idle.material");
 	sprite->size = {14, 38};
@@ -114,8 +367,9 @@ APlayer::APlayer()
 
 void APlayer::beginPlay()
 {
-	bodyComp->init({14, 38}, BODYGROUP_PLAYER);
+	bodyComp->init({14, 38}, LAYER_PLAYER, LAYER_WORLD | LAYER_SKELETON | LAYER_BOSS);
 	healthComp->body = bodyComp->body;
+	DamageFieldManager::get().addReceiver(healthComp->body, BODYTYPE_DYNAMIC, healthComp);
 }
 
 void APlayer::update(f64 delta)
@@ -222,13 +476,14 @@ void APlayer::attack()
 	damageFieldCreate(fieldPos, {30, 30}, DamageGroup::PLAYER, pos);
 }
 
-ASkeleton::ASkeleton()
+template<typename Self>
+ASkeletonBase<Self>::ASkeletonBase()
 {
 	bodySize = {14, 37};
-	target = Ord.make_CTarget();
-	healthComp = Ord.make_CHealth();
+	target = Ord.make<CTarget>();
+	healthComp = Ord.make<CHealth>();
 	healthComp->dmgGroup = DamageGroup::ENEMY;
-	sprite = Ord.make_Sprite();
+	sprite = Ord.make<Sprite>();
 	sprite->transform = transform;
 	sprite->size = {20, 37};
 	sprite->materialName = H("skeleton_idle.material");
@@ -246,18 +501,22 @@ ASkeleton::ASkeleton()
 	sndAttackNameHashes.push(H("snd_skeleton_attack3.ogg"));
 }
 
-void ASkeleton::beginPlay()
+template<typename Self>
+void ASkeletonBase<Self>::beginPlay()
 {
-	bodyComp->init(bodySize, BODYGROUP_SKELETON);
+	// skeletons walk through each other
+	bodyComp->init(bodySize, LAYER_SKELETON, LAYER_WORLD | LAYER_PLAYER | LAYER_BOSS);
 	healthComp->body = bodyComp->body;
+	DamageFieldManager::get().addReceiver(healthComp->body, BODYTYPE_DYNAMIC, healthComp);
 }
 
-void ASkeleton::update(f64 delta)
+template<typename Self>
+void ASkeletonBase<Self>::update(f64 delta)
 {
 	Actor::update(delta);
 
 	if(healthComp->isDead()) {
-		die();
+		self().die();
 		destroy();
 		return;
 	}
@@ -329,10 +588,10 @@ void ASkeleton::update(f64 delta)
 			bodyComp->body->vel.x = xSpeed;
 			dir = 1;
 			turnCooldown = turnCooldownMax;
-			playRun();
+			self().playRun();
 		}
 		else {
-			playIdle();
+			self().playIdle();
 		}
 	}
 	else if(input.x == -1) {
@@ -340,27 +599,27 @@ void ASkeleton::update(f64 delta)
 			bodyComp->body->vel.x = -xSpeed;
 			dir = -1;
 			turnCooldown = turnCooldownMax;
-			playRun();
+			self().playRun();
 		}
 		else {
-			playIdle();
+			self().playIdle();
 		}
 	}
 	else {
 		bodyComp->body->vel.x = 0;
-		playIdle();
+		self().playIdle();
 	}
 
 	// actual attack
 	if(attackAnimCooldown > 0 && attackAnimCooldown < attackAnimCooldownMax - attackTime) {
 		lsk_printf("SMACK!");
-		attack();
+		self().attack();
 		AudioGet.play(sndAttackNameHashes[lsk_rand() % sndAttackNameHashes.count()]);
 		attackTime = 10000;
 	}
 
 	if(attackAnimCooldown > 0 && attackAnimCooldown > attackAnimCooldownMax - attackTimeMax) {
-		playAttack();
+		self().playAttack();
 	}
 
 	// attack animation
@@ -371,7 +630,8 @@ void ASkeleton::update(f64 delta)
 	}
 }
 
-void ASkeleton::attack()
+template<typename Self>
+void ASkeletonBase<Self>::attack()
 {
 	lsk_Vec2 pos = {transform->position.x, transform->position.y};
 	f32 xOffset = 14.f;
@@ -382,7 +642,8 @@ void ASkeleton::attack()
 	damageFieldCreate(fieldPos, {20, 20}, DamageGroup::ENEMY, pos);
 }
 
-void ASkeleton::die()
+template<typename Self>
+void ASkeletonBase<Self>::die()
 {
 	constexpr u32 dieSounds[] = {
 		H("snd_skeleton_die1.ogg"),
@@ -392,7 +653,8 @@ void ASkeleton::die()
 	AudioGet.play(dieSounds[lsk_rand() % 3], 0.5f + lsk_randf() * 0.3f);
 }
 
-void ASkeleton::playIdle()
+template<typename Self>
+void ASkeletonBase<Self>::playIdle()
 {
 	sprite->materialName = H("skeleton_idle.material");
 	if(dir == 1) {
@@ -405,7 +667,8 @@ void ASkeleton::playIdle()
 	}
 }
 
-void ASkeleton::playRun()
+template<typename Self>
+void ASkeletonBase<Self>::playRun()
 {
 	if(dir == 1) {
 	sprite->materialName = H("skeleton_running.material");
@@ -419,7 +682,8 @@ void ASkeleton::playRun()
 	}
 }
 
-void ASkeleton::playAttack()
+template<typename Self>
+void ASkeletonBase<Self>::playAttack()
 {
 	sprite->materialName = H("skeleton_attack.material");
 	if(dir == 1) {
@@ -518,6 +782,9 @@ void ASkeletonBigShield::playAttack()
 	}
 }
 
+template struct ASkeletonBase<ASkeleton>;
+template struct ASkeletonBase<ASkeletonBigShield>;
+
 void MaterialAnimation::update(f64 delta)
 {
 	if(paused) return;
@@ -533,12 +800,16 @@ ADragon::ADragon()
 	curPathId = 0;
 	damageCD = 0;
 
+	BodyRectAligned partBody(28, 28);
+	partBody.layer = LAYER_BOSS;
+
 	for(i32 i = 0; i < parts._capacity; ++i) {
 		parts.push(Part());
-		parts[i].body = headBody = Physics.bodiesStatic.push(BodyRectAligned(28, 28));
+		parts[i].body = headBody = Physics.addKinematic(partBody);
+		DamageFieldManager::get().addReceiver(parts[i].body, BODYTYPE_KINEMATIC);
 	}
 
-	headBody = Physics.bodiesStatic.push(BodyRectAligned(28, 28));
+	headBody = Physics.addKinematic(partBody);
 }
 
 void ADragon::update(f64 delta)
@@ -556,7 +827,6 @@ void ADragon::update(f64 delta)
 	headBody->setPos(pos);
 
 	f32 angle = -atan2(vel.x, vel.y);
-	lsk_Quat rot = lsk_QuatAxisRotation({0,0,1}, angle + LSK_PI/2.f);
 	lsk_Vec2 origin = {49/2.f, 14.f};
 
 	lsk_Vec2 localPos = {14.f, 14.f};
@@ -570,14 +840,9 @@ void ADragon::update(f64 delta)
 	damageFieldCreate(pos + localPos + lsk_Vec2{-16, -16}, {32, 32}, DamageGroup::ENEMY, pos + localPos);
 
 	i32 z = 200;
-	lsk_Mat4 modelMatrix = lsk_Mat4Translate(lsk_Vec3{pos + localPos, 0});
-	modelMatrix = modelMatrix * lsk_QuatMatrix(rot);
-	modelMatrix = modelMatrix * lsk_Mat4Translate(lsk_Vec3{-origin, 0});
-	modelMatrix = modelMatrix * lsk_Mat4Scale(lsk_Vec3{49, 28, 1});
-
 	DrawCommand cmd;
 	cmd.vao = Renderer._quadVao;
-	cmd.modelMatrix = modelMatrix;
+	cmd.setTransform(pos + localPos, {49, 28}, angle + LSK_PI/2.f, origin);
 	cmd.z = z;
 	cmd.setMaterial(H("dragon_head.material"));
 	Renderer.queue(cmd);
@@ -597,9 +862,11 @@ void ADragon::update(f64 delta)
 
 
 		if(p.alive == 1 && damageCD <= 0.0 && noPartDamaged) {
-			for(const auto& field: DamageFieldManager::get().fields) {
-				if(field.dmgGroup == DamageGroup::PLAYER &&
-				   intersectTest(field.box, p.body->box, nullptr)) {
+			const DamageFieldManager& dmgFields = DamageFieldManager::get();
+			const DamageHit* pHits;
+			const u32 hitCount = dmgFields.findHits(BODYTYPE_KINEMATIC, p.body._id, &pHits);
+			for(u32 h = 0; h < hitCount; ++h) {
+				if(pHits[h].dmgGroup == DamageGroup::PLAYER) {
 					AudioGet.play(H("snd_punch_hit.ogg"));
 					p.alive = false;
 					damageCD = 0.3;
@@ -630,9 +897,10 @@ void ADragon::place(const lsk_Array<lsk_Vec2, 16>* pDragonPath_)
 
 void ADragon::endPlay()
 {
-	Physics.bodiesStatic.remove(headBody);
+	Physics.removeKinematic(headBody);
 	for(auto& p: parts) {
-		Physics.bodiesStatic.remove(p.body);
+		DamageFieldManager::get().removeReceiver(p.body, BODYTYPE_KINEMATIC);
+		Physics.removeKinematic(p.body);
 	}
 }
 
@@ -651,7 +919,7 @@ bool LD37_Window::postInit()
 	AudioGet._soloud.setGlobalVolume(GLOBAL_VOLUME);
 	Ord.init();
 	Physics.init();
-	DamageFieldManager::get().init();
+	DamageFieldManager::get().init(_updateDt);
 
 	Renderer.viewResize(320, 180);
 
@@ -716,31 +984,16 @@ bool LD37_Window::postInit()
 	// map collision
 	for(const auto& layer: gamemap.tileLayers) {
 		if(H(layer.name.c_str()) == H("foreground")) {
-			for(i32 y = 0; y < layer.height; ++y) {
-				i32 chain_startX = -1;
-				i32 chain_endX = -1;
-				for(i32 x = 0; x < layer.width; ++x) {
-					if(layer.data[y * layer.width + x] != 0) {
-						if(chain_startX == -1) chain_startX = x;
-					}
-					else if(chain_startX != -1) {
-						chain_endX = x;
-						f32 sizeX = (chain_endX - chain_startX) * 14;
-						auto body = Physics.bodiesStatic.push(BodyRectAligned(sizeX, 14));
-						body->setPos({chain_startX * 14.f, y * 14.f});
-						chain_startX = -1;
-						chain_endX = -1;
-					}
-				}
-
-				if(chain_startX != -1) {
-					chain_endX = layer.width;
-					f32 sizeX = (chain_endX - chain_startX) * 14;
-					auto body = Physics.bodiesStatic.push(BodyRectAligned(sizeX, 14));
-					body->setPos({chain_startX * 14.f, y * 14.f});
-				}
+			lsk_DArray<CollisionRect> rects(64);
+			gamemap.bakeCollision(layer, &rects);
+
+			for(const auto& rect: rects) {
+				BodyRectAligned body(rect.width * 14.f, rect.height * 14.f);
+				body.layer = LAYER_WORLD;
+				body.oneWay = rect.oneWay;
+				body.setPos({rect.x * 14.f, rect.y * 14.f});
+				Physics.addStatic(body);
 			}
-
 			break;
 		}
 	}
@@ -756,14 +1009,68 @@ bool LD37_Window::postInit()
 		}
 	}
 
-	start_preGame();
-	//start_spawn();
+	addSystems();
+	runSequence(seq_intro);
 
 	return true;
 }
 
+void LD37_Window::addSystems()
+{
+	// entities and coroutines touch anything, they run alone
+	Systems.add("physics", [](void*, f64 delta) {
+		Physics.update(delta);
+	}, nullptr, 0, ACCESS_BODIES, SYSTEM_USES_JOBS);
+
+	Systems.add("window", [](void* pWin, f64 delta) {
+		((LD37_Window*)pWin)->IGameWindow::update(delta);
+	}, this, SYSTEM_ACCESS_ALL, SYSTEM_ACCESS_ALL);
+
+	Systems.add("damage", [](void*, f64) {
+		DamageFieldManager::get().update();
+	}, nullptr, ACCESS_BODIES, ACCESS_DAMAGE | ACCESS_HEALTH | ACCESS_AUDIO);
+
+	Systems.add("animations", [](void* pWin, f64 delta) {
+		for(auto& anim: ((LD37_Window*)pWin)->matAnims) {
+			anim.update(delta);
+		}
+	}, this, 0, ACCESS_MATERIALS);
+
+	Systems.add("destroy", [](void*, f64) {
+		Ord.destroyQueued();
+	}, nullptr, SYSTEM_ACCESS_ALL, SYSTEM_ACCESS_ALL);
+
+	// Transform has nothing to update
+	Systems.add("bodies", [](void*, f64 delta) {
+		Ord.updateComponents<CBodyComponent>(delta);
+	}, nullptr, ACCESS_BODIES, ACCESS_TRANSFORM);
+
+	// reads the transforms bodies writes: next wave, health and targets run beside bodies
+	Systems.add("sprites", [](void*, f64 delta) {
+		Ord.updateComponents<Sprite>(delta);
+	}, nullptr, ACCESS_TRANSFORM, ACCESS_RENDER_QUEUE);
+
+	Systems.add("health", [](void*, f64 delta) {
+		Ord.updateComponents<CHealth>(delta);
+	}, nullptr, 0, ACCESS_HEALTH);
+
+	Systems.add("targets", [](void*, f64 delta) {
+		Ord.updateComponents<CTarget>(delta);
+	}, nullptr, 0, ACCESS_TARGET);
+
+	Systems.add("entities", [](void*, f64 delta) {
+		Ord.updateEntities(delta);
+	}, nullptr, SYSTEM_ACCESS_ALL, SYSTEM_ACCESS_ALL);
+
+	Systems.add("map", [](void* pWin, f64) {
+		((LD37_Window*)pWin)->gamemap.draw();
+	}, this, 0, ACCESS_RENDER_QUEUE);
+}
+
 void LD37_Window::preExit()
 {
+	Systems.clear();
+	Coroutines.stopAll();
 	Ord.destroy();
 	DamageFieldManager::get().destroy();
 	Physics.destroy();
@@ -772,16 +1079,7 @@ void LD37_Window::preExit()
 
 void LD37_Window::update(f64 delta)
 {
-	for(auto& anim: matAnims) {
-		anim.update(delta);
-	}
-
-	Physics.update(delta);
-	IGameWindow::update(delta);
-	DamageFieldManager::get().update(delta);
-	Ord.update(delta);
-
-	gamemap.draw();
+	Systems.run(delta);
 
 #ifdef CONF_DEBUG
 	if(debugCollisions) {
@@ -793,6 +1091,10 @@ void LD37_Window::update(f64 delta)
 			Renderer.queueSprite(H("body_static.material"), 1000, statBody.box.min,
 								 statBody.box.max - statBody.box.min);
 		}
+		for(const auto& kinBody: Physics.bodiesKinematic) {
+			Renderer.queueSprite(H("body_static.material"), 1000, kinBody.box.min,
+								 kinBody.box.max - kinBody.box.min);
+		}
 		for(const auto& field: DamageFieldManager::get().fields) {
 			Renderer.queueSprite(H("body_static.material"), 1000, field.box.min,
 								 field.box.max - field.box.min);
@@ -883,13 +1185,81 @@ bool LD37_Window::handleEvent(SDL_Event event)
 	return true;
 }
 
+void LD37_Window::runSequence(CoroutineFunc seq)
+{
+	Coroutines.stop(stateSeq);
+	stateSeq = Coroutines.start(seq, this);
+}
+
+// story -> wake -> explore
+void LD37_Window::seq_intro(Coroutine& co, void* pUserData)
+{
+	LD37_Window& win = *(LD37_Window*)pUserData;
+	CO_BEGIN(co);
+
+	win.start_preGame();
+	CO_WAIT(co, 10.0);
+
+	win.start_spawn();
+	CO_WAIT(co, 1.4);
+	win.pWakeAnim->paused = 1;
+	CO_WAIT(co, 1.6);
+
+	win.start_explore();
+
+	CO_END(co);
+}
+
+// defeat -> wake -> respawn
+void LD37_Window::seq_defeat(Coroutine& co, void* pUserData)
+{
+	LD37_Window& win = *(LD37_Window*)pUserData;
+	CO_BEGIN(co);
+
+	win.start_defeat();
+	CO_WAIT(co, 1.2);
+	win.pDeathAnim->paused = 1;
+	CO_WAIT(co, 1.3);
+	win.defeatFadeOut = true;
+	CO_WAIT(co, 1.5);
+
+	win.start_spawn();
+	CO_WAIT(co, 1.4);
+	win.pWakeAnim->paused = 1;
+	CO_WAIT(co, 1.6);
+
+	win.start_explore();
+
+	CO_END(co);
+}
+
+void LD37_Window::seq_chaliceSummon(Coroutine& co, void* pUserData)
+{
+	LD37_Window& win = *(LD37_Window*)pUserData;
+	CO_BEGIN(co);
+
+	win.start_chaliceSummon();
+	CO_WAIT(co, 2.0);
+	win.start_boss();
+
+	CO_END(co);
+}
+
+void LD37_Window::seq_victory(Coroutine& co, void* pUserData)
+{
+	LD37_Window& win = *(LD37_Window*)pUserData;
+	CO_BEGIN(co);
+
+	win.start_victory();
+	CO_WAIT(co, 6.0);
+	win._running = false;
+
+	CO_END(co);
+}
+
 void LD37_Window::start_preGame()
 {
 	gamestate = GAMESTATE_PREGAME;
-
-	Timers.add(10.0, [&] {
-		start_spawn();
-	});
 }
 
 void LD37_Window::start_spawn()
@@ -900,19 +1270,11 @@ void LD37_Window::start_spawn()
 	pWakeAnim->reset();
 	pWakeAnim->paused = 0;
 
-	Timers.add(1.4, [&] {
-		pWakeAnim->paused = 1;
-	});
-
-	Timers.add(3, [&] {
-		start_explore();
-	});
-
-	for(auto& skel: Ord._entity_ASkeleton) {
+	for(auto& skel: Ord.entityArray<ASkeleton>()) {
 		skel.destroy();
 	}
 
-	for(auto& skel: Ord._entity_ASkeletonBigShield) {
+	for(auto& skel: Ord.entityArray<ASkeletonBigShield>()) {
 		skel.destroy();
 	}
 
@@ -923,7 +1285,7 @@ void LD37_Window::start_explore()
 {
 	gamestate = GAMESTATE_EXPLORE;
 
-	player = Ord.spawn_APlayer();
+	player = Ord.spawn<APlayer>();
 	player->beginPlay();
 	player->setPos(playerSpawnPos);
 	player->setPos(dragonPath[4]);
@@ -937,12 +1299,12 @@ void LD37_Window::start_explore()
 			if(H(obj.type.c_str()) == H("skeleton_spawn")) {
 				i32 r = lsk_rand()%2;
 				if(r == 0) {
-					auto skeleton = Ord.spawn_ASkeleton();
+					auto skeleton = Ord.spawn<ASkeleton>();
 					skeleton->beginPlay();
 					skeleton->setPos({(f32)obj.x, (f32)obj.y});
 				}
 				else {
-					auto skeleton = Ord.spawn_ASkeletonBigShield();
+					auto skeleton = Ord.spawn<ASkeletonBigShield>();
 					skeleton->beginPlay();
 					skeleton->setPos({(f32)obj.x, (f32)obj.y});
 				}
@@ -957,18 +1319,14 @@ void LD37_Window::start_chaliceSummon()
 	player->input = {};
 	player->healthComp->health = player->healthComp->maxHealth;
 
-	for(auto& skel: Ord._entity_ASkeleton) {
+	for(auto& skel: Ord.entityArray<ASkeleton>()) {
 		skel.destroy();
 	}
 
-	for(auto& skel: Ord._entity_ASkeletonBigShield) {
+	for(auto& skel: Ord.entityArray<ASkeletonBigShield>()) {
 		skel.destroy();
 	}
 
-	Timers.add(2.0, [&] {
-		start_boss();
-	});
-
 	AudioGet._soloud.stopAll();
 	AudioGet.play(H("snd_chalice_summon.ogg"));
 }
@@ -977,7 +1335,7 @@ void LD37_Window::start_boss()
 {
 	gamestate = GAMESTATE_BOSS;
 
-	dragon = Ord.spawn_ADragon();
+	dragon = Ord.spawn<ADragon>();
 	dragon->place(&dragonPath);
 }
 
@@ -992,16 +1350,7 @@ void LD37_Window::start_defeat()
 
 	pDeathAnim->paused = 0;
 	pDeathAnim->reset();
-
-	Timers.add(1.2, [&] {
-		pDeathAnim->paused = 1;
-	});
-
-	Timers.add(4.0, [&] {
-		start_spawn();
-	});
-
-	lastStateChangeTime = Timers.getTime();
+	defeatFadeOut = false;
 
 	AudioGet.play(H("snd_death.ogg"));
 }
@@ -1010,14 +1359,6 @@ void LD37_Window::start_victory()
 {
 	gamestate = GAMESTATE_VICTORY;
 	AudioGet._soloud.stopAll();
-
-	/*Timers.add(5, [&] {
-		AudioGet.play(H("snd_boop.ogg"));
-	});*/
-
-	Timers.add(6, [&] {
-		_running = false;
-	});
 }
 
 void LD37_Window::update_preGame(f64 delta)
@@ -1040,14 +1381,14 @@ void LD37_Window::update_explore(f64 delta)
 			player->transform->position.y
 		};
 		player->destroy();
-		start_defeat();
+		runSequence(seq_defeat);
 		return;
 	}
 
 	camX = lsk_clamp(player->bodyComp->body->box.min.x - 120.f, 0.f, gamemap.width*14.f - 320);
 	Renderer.viewSetPos(camX, 0);
 
-	for(auto& comp: Ord._comp_CTarget) {
+	for(auto& comp: Ord.componentArray<CTarget>()) {
 		comp.pos.x = player->transform->position.x;
 		comp.pos.y = player->transform->position.y;
 	}
@@ -1062,7 +1403,7 @@ void LD37_Window::update_explore(f64 delta)
 	}
 
 	if(player->transform->position.x > (182*14.f)) {
-		start_chaliceSummon();
+		runSequence(seq_chaliceSummon);
 	}
 }
 
@@ -1075,7 +1416,7 @@ void LD37_Window::update_boss(f64 delta)
 {
 	if(player->healthComp->isDead()) {
 		dragon->destroy();
-		start_defeat();
+		runSequence(seq_defeat);
 		return;
 	}
 
@@ -1092,13 +1433,13 @@ void LD37_Window::update_boss(f64 delta)
 	}
 
 	if(dragon->isDead()) {
-		start_victory();
+		runSequence(seq_victory);
 	}
 }
 
 void LD37_Window::update_defeat(f64 delta)
 {
-	if((Timers.getTime() - lastStateChangeTime) > 2.5) {
+	if(defeatFadeOut) {
 		Renderer.queueSprite(H("black.material"), 1000, {camX, 0}, {320, 180});
 	}
 	else {
@@ -1113,15 +1454,130 @@ void LD37_Window::update_victory(f64 delta)
 	Renderer.queueSprite(H("victory.material"), 1000, {0, 0}, {320, 180});
 }
 
+/**
+ * Bodies and sprites update, Ordinator Ref layout vs archetype, prints timings
+ * - the real components and the code updateComponents() runs on them, Transform is read in place
+ *   instead of through the Ref in the archetype
+ * - twice as many spawned then half killed at random, so both layouts carry churn
+ * - only the updates are timed, the frame is sorted by endFrame() after each
+ */
+static void archetypeBenchmark(i32 entityCount, i32 frameCount)
+{
+	const f64 delta = 1.0 / 60.0;
+	Physics.init();
+	Renderer.init(RendererBackend::NONE);
+	Shader_Color::Material material;
+	material.color = {1, 1, 1, 1};
+	Renderer.materials.set(MaterialType::COLOR, H("bench.material"), material);
+
+	lsk_DSparseArray<Transform> transforms(entityCount * 2);
+	lsk_DSparseArray<CBodyComponent> bodyComps(entityCount * 2);
+	lsk_DSparseArray<Sprite> sprites(entityCount * 2);
+
+	// rows hold copies, their Refs still point to the Ordinator layout ones (ids, bodies)
+	ArchetypeStorage<Transform, CBodyComponent, Sprite> archetype;
+	archetype.init();
+
+	struct BenchEntity {
+		Ref<Transform> transform;
+		Ref<CBodyComponent> bodyComp;
+		Ref<Sprite> sprite;
+		ArchetypeHandle row;
+	};
+	lsk_DArray<BenchEntity> entities(entityCount * 2);
+
+	for(i32 i = 0; i < entityCount * 2; ++i) {
+		BenchEntity ent;
+		ent.transform = transforms.push(Transform());
+		ent.bodyComp = bodyComps.push(CBodyComponent());
+		ent.bodyComp->transform = ent.transform;
+		ent.bodyComp->init({14, 30}, LAYER_SKELETON, LAYER_WORLD | LAYER_PLAYER | LAYER_BOSS);
+		ent.bodyComp->body->setPos({(f32)(i % 100) * 16.f, (f32)(i / 100) * 32.f});
+		ent.sprite = sprites.push(Sprite());
+		ent.sprite->transform = ent.transform;
+		ent.sprite->materialName = H("bench.material");
+		ent.sprite->size = {14, 30};
+		ent.row = archetype.add(ent.transform.get(), ent.bodyComp.get(), ent.sprite.get());
+		entities.push(ent);
+	}
+
+	for(i32 i = 0; i < entityCount; ++i) {
+		const u32 victim = lsk_rand() % entities.count();
+		BenchEntity& ent = entities[victim];
+		ent.bodyComp->endPlay();
+		transforms.remove(ent.transform);
+		bodyComps.remove(ent.bodyComp);
+		sprites.remove(ent.sprite);
+		archetype.remove(ent.row);
+		entities.remove(victim);
+	}
+
+	f64 refTime = 0;
+	for(i32 f = 0; f < frameCount; ++f) {
+		Renderer.beginFrame();
+		timept t0 = timeNow();
+		for(auto& bodyComp: bodyComps) {
+			bodyComp.update(delta);
+		}
+		for(auto& sprite: sprites) {
+			sprite.update(delta);
+		}
+		refTime += timeDurSince(t0);
+		Renderer.endFrame();
+	}
+	f64 checksumRef = 0;
+	for(auto& transform: transforms) {
+		checksumRef += transform.position.x + transform.position.y;
+	}
+
+	f64 archetypeTime = 0;
+	for(i32 f = 0; f < frameCount; ++f) {
+		Renderer.beginFrame();
+		timept t0 = timeNow();
+		archetype.forEach<Transform, CBodyComponent, Sprite>(
+			[](Transform& transform, CBodyComponent& bodyComp, Sprite& sprite) {
+				bodyComp.moveTransform(transform);
+				sprite.queue(transform, sprite.transform._id + 1);
+			});
+		archetypeTime += timeDurSince(t0);
+		Renderer.endFrame();
+	}
+	f64 checksumArchetype = 0;
+	archetype.forEach<Transform>([&checksumArchetype](Transform& transform) {
+		checksumArchetype += transform.position.x + transform.position.y;
+	});
+
+	lsk_printf("archetypeBenchmark: %d entities, %d frames", entityCount, frameCount);
+	lsk_printf("  Ref layout: %.3fms/frame (checksum %g)", refTime * 1000.0 / frameCount, checksumRef);
+	lsk_printf("  archetype:  %.3fms/frame (checksum %g, %u chunks of %u)", archetypeTime * 1000.0 / frameCount,
+			   checksumArchetype, archetype.chunkCount(), archetype.CHUNK_CAPACITY);
+	lsk_printf("  speedup: x%.2f", refTime / archetypeTime);
+
+	archetype.destroy();
+	Renderer.destroy();
+	Physics.destroy();
+}
+
 #ifdef _WIN32
 i32 CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 #else
-i32 main()
+i32 main(i32 argc, char** argv)
 #endif
 {
 	lsk_printf("Ludum Dare 37");
 	AllocDefault_set(&GMalloc);
 
+#ifdef _WIN32
+	const char* cmdLine = lpCmdLine;
+#else
+	const char* cmdLine = argc > 1 ? argv[1] : "";
+#endif
+	// entity layout benchmark, runs without a window and exits
+	if(strstr(cmdLine, "--bench-archetype")) {
+		archetypeBenchmark(1000, 600);
+		return 0;
+	}
+
 	i32 sdlInit = SDL_Init(SDL_INIT_VIDEO);
 	if(sdlInit == -1) {
 		lsk_errf("Error: %s", SDL_GetError());
@@ -1141,21 +1597,27 @@ i32 main()
 	return 0;
 }
 
-void CBodyComponent::init(const lsk_Vec2& size, i32 bodyGroup)
+void CBodyComponent::init(const lsk_Vec2& size, u32 layer, u32 mask)
 {
-	body = Physics.bodiesDynamic.push(BodyRectAligned(size.x, size.y));
-	body->group = bodyGroup;
+	body = Physics.addDynamic(BodyRectAligned(size.x, size.y));
+	body->layer = layer;
+	body->mask = mask;
 }
 
 void CBodyComponent::update(f64 delta)
+{
+	moveTransform(transform.get());
+}
+
+void CBodyComponent::moveTransform(Transform& transform)
 {
 	assert(body.valid());
-	transform->position.x = body->box.min.x;
-	transform->position.y = body->box.min.y;
+	transform.position.x = body->box.min.x;
+	transform.position.y = body->box.min.y;
 }
 
 void CBodyComponent::endPlay()
 {
 	assert(body.valid());
-	Physics.bodiesDynamic.remove(body);
+	Physics.removeDynamic(body);
 }
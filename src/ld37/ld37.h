@@ -4,18 +4,22 @@
 #include <engine/tiledmap.h>
 #include <engine/base_entity.h>
 #include <engine/physics.h>
+#include <engine/coroutine.h>
 
 struct COMPONENT CBodyComponent
 {
 	Ref<Transform> transform;
 	Ref<BodyRectAligned> body;
 
-	void init(const lsk_Vec2& size, i32 bodyGroup);
+	void init(const lsk_Vec2& size, u32 layer, u32 mask);
 	void update(f64 delta);
 	void endPlay();
+	// update() without the Ref
+	void moveTransform(Transform& transform);
 };
 
-struct ENTITY Actor: IEntityBase
+// shared by the actor entities, not an entity itself
+struct Actor: IEntityBase
 {
 	Ref<Transform> transform;
 	Ref<CBodyComponent> bodyComp;
@@ -23,6 +27,12 @@ struct ENTITY Actor: IEntityBase
 	Actor();
 
 	void setPos(lsk_Vec2 pos);
+
+	template<typename F>
+	void forEachComponent(F&& f) {
+		f(transform);
+		f(bodyComp);
+	}
 };
 
 enum class DamageGroup: i32 {
@@ -32,24 +42,80 @@ enum class DamageGroup: i32 {
 	ENEMY
 };
 
+#define DAMAGE_WHEEL_SLOTS 64 // power of two
+
 struct DamageField
 {
 	lsk_AABB2 box;
 	lsk_Vec2 sourcePos;
 	DamageGroup dmgGroup;
-	f64 lifetime;
+	u32 _expireTick = 0;
+	i32 _wheelPrev = -1; // fields of the same wheel slot
+	i32 _wheelNext = -1;
+};
+
+struct CHealth;
+
+// a body fields are tested against
+struct DamageReceiver
+{
+	Ref<BodyRectAligned> body;
+	u32 bodyKey; // body type << 24 | body ref id
+	Ref<CHealth> health; // optional, takes damage from fields of other groups
+};
+
+// a field overlapping a receiver at the start of the frame
+struct DamageHit
+{
+	u32 bodyKey;
+	u32 fieldId; // only valid inside update(), expired fields are swap-removed after resolving
+	u32 receiverId;
+	DamageGroup dmgGroup; // of the field
 };
 
+// field or receiver in a spatial hash cell
+struct DamageBin
+{
+	u32 cell;
+	u32 item; // receiver id, or field id | DAMAGE_BIN_FIELD
+};
+
+/**
+ * Damage fields are resolved once per frame in update()
+ * - fields and receivers are binned in a spatial hash, only pairs sharing a cell are tested
+ * - hits are sent to the receivers' CHealth::takeDamage(), other receivers use findHits()
+ * - fields are packed and swap-removed, expiry is bucketed by tick in a timing wheel
+ *   (fields outliving DAMAGE_WHEEL_SLOTS ticks are skipped until their round comes)
+ */
 struct DamageFieldManager
 {
 	SINGLETON_IMP(DamageFieldManager)
 
 	lsk_DArray<DamageField> fields;
-
-	void init();
+	lsk_DArray<DamageReceiver> receivers;
+	lsk_DArray<DamageHit> hits; // sorted by body, then field
+	lsk_DArray<DamageBin> _bins;
+	i32 _wheel[DAMAGE_WHEEL_SLOTS]; // first field expiring in each slot, -1 if none
+	u32 _tick = 0;
+	f64 _tickDt = 1.0;
+
+	// tickDt: fixed update step, update() is called once per step
+	void init(f64 tickDt);
 	void destroy();
 
-	void update(f64 delta);
+	// resolved from the next update() on, for lifetime seconds (at least one update)
+	void add(const DamageField& field, f64 lifetime);
+
+	void addReceiver(const Ref<BodyRectAligned>& body, u8 bodyType, const Ref<CHealth>& health = Ref<CHealth>());
+	void removeReceiver(const Ref<BodyRectAligned>& body, u8 bodyType);
+
+	void update();
+	// hits on one body, returns count
+	u32 findHits(u8 bodyType, u32 bodyId, const DamageHit** out_ppHits) const;
+
+	void _binBox(const lsk_AABB2& box, u32 item);
+	void _unlinkField(i32 id);
+	void _removeField(i32 id);
 };
 
 void damageFieldCreate(const lsk_Vec2& pos, const lsk_Vec2& size, DamageGroup dmgGroup,
@@ -68,7 +134,7 @@ struct COMPONENT CHealth
 
 	void takeDamage(const DamageField& source);
 	void update(f64 delta);
-	void endPlay() {}
+	void endPlay();
 
 	inline bool isDead() const {
 		return health <= 0;
@@ -82,7 +148,7 @@ struct Input
 	i32 attack = 0;
 };
 
-struct ENTITY APlayer: Actor
+struct ENTITY APlayer final: Actor
 {
 	Ref<Sprite> sprite;
 	Ref<CHealth> healthComp;
@@ -97,12 +163,19 @@ struct ENTITY APlayer: Actor
 
 	APlayer();
 
-	void beginPlay() override;
-	void update(f64 delta) override;
+	void beginPlay();
+	void update(f64 delta);
 
 	bool canJump() const;
 	bool isGrounded() const;
 	void attack();
+
+	template<typename F>
+	void forEachComponent(F&& f) {
+		Actor::forEachComponent(f);
+		f(sprite);
+		f(healthComp);
+	}
 };
 
 struct COMPONENT CTarget
@@ -113,7 +186,12 @@ struct COMPONENT CTarget
 	void endPlay() {}
 };
 
-struct ENTITY ASkeleton: Actor
+/**
+ * Skeleton behaviour, Self is the final skeleton type
+ * - attack, die and the animations are called on Self: a type hides them to change them
+ */
+template<typename Self>
+struct ASkeletonBase: Actor
 {
 	lsk_Vec2 bodySize;
 	Ref<CTarget> target;
@@ -142,31 +220,50 @@ struct ENTITY ASkeleton: Actor
 
 	bool canAdvance = true;
 
-	ASkeleton();
+	ASkeletonBase();
 
-	void beginPlay() override;
-	void update(f64 delta) override;
-	virtual void attack();
-	virtual void die();
+	void beginPlay();
+	void update(f64 delta);
+	void attack();
+	void die();
+
+	void playIdle();
+	void playRun();
+	void playAttack();
+
+	template<typename F>
+	void forEachComponent(F&& f) {
+		Actor::forEachComponent(f);
+		f(target);
+		f(healthComp);
+		f(sprite);
+	}
 
-	virtual void playIdle();
-	virtual void playRun();
-	virtual void playAttack();
+	inline Self& self() {
+		return *static_cast<Self*>(this);
+	}
 };
 
-struct ENTITY ASkeletonBigShield: ASkeleton
+struct ENTITY ASkeleton final: ASkeletonBase<ASkeleton>
+{
+};
+
+struct ENTITY ASkeletonBigShield final: ASkeletonBase<ASkeletonBigShield>
 {
 	ASkeletonBigShield();
 
-	//void update(f64 delta) override;
-	void attack() override;
-	void die() override;
-	void playIdle() override;
-	void playRun() override;
-	void playAttack() override;
+	void attack();
+	void die();
+	void playIdle();
+	void playRun();
+	void playAttack();
 };
 
-struct ENTITY ADragon: IEntityBase
+// defined in ld37.cpp
+extern template struct ASkeletonBase<ASkeleton>;
+extern template struct ASkeletonBase<ASkeletonBigShield>;
+
+struct ENTITY ADragon final: IEntityBase
 {
 	const lsk_Array<lsk_Vec2, 16>* pDragonPath;
 	f32 damageCD = 0;
@@ -184,9 +281,9 @@ struct ENTITY ADragon: IEntityBase
 
 
 	ADragon();
-	void update(f64 delta) override;
+	void update(f64 delta);
 	void place(const lsk_Array<lsk_Vec2, 16>* pDragonPath_);
-	void endPlay() override;
+	void endPlay();
 	bool isDead();
 };
 
@@ -217,7 +314,8 @@ struct LD37_Window: IGameWindow
 	lsk_Vec2 playerSpawnPos;
 	lsk_Vec2 lastPlayerPos;
 
-	f64 lastStateChangeTime = 0;
+	bool defeatFadeOut = false;
+	CoroutineHandle stateSeq; // sequence of the current state
 
 	enum {
 		GAMESTATE_PREGAME = 0,
@@ -240,6 +338,13 @@ struct LD37_Window: IGameWindow
 	void render() override;
 	bool handleEvent(SDL_Event event) override;
 
+	void addSystems();
+	void runSequence(CoroutineFunc seq);
+	static void seq_intro(Coroutine& co, void* pUserData);
+	static void seq_defeat(Coroutine& co, void* pUserData);
+	static void seq_chaliceSummon(Coroutine& co, void* pUserData);
+	static void seq_victory(Coroutine& co, void* pUserData);
+
 	void start_preGame();
 	void start_spawn();
 	void start_explore();